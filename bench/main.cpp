@@ -0,0 +1,625 @@
+#include "emulator.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+constexpr u64 ROM_SIZE = 0x8000 * 4;
+
+constexpr u64 CPU_MIX_CYCLES = 2000000;
+constexpr u64 PPU_FRAMES = 60;
+constexpr u64 LCD_OFF_FRAMES = 60;
+constexpr u64 BUS_STORM_ITERATIONS = 200000;
+constexpr u64 TIMER_CYCLES = 1000000;
+constexpr u64 SYSTEM_FRAMES = 120;
+constexpr u64 SKIPPED_FRAMES = 120;
+constexpr u64 IDLE_FRAMES = 120;
+constexpr u32 BATCH_INSTANCES = 16;
+constexpr u64 BATCH_STEPS = 30;
+
+struct Benchmark_Result
+{
+    const char *name;
+    u64 operations;
+    u64 emulated_cycles; // 0 when the workload has no meaningful emulated clock
+    double best_ns;
+};
+
+// Homebrew workload ROM: an MBC1 cartridge that turns the LCD on with the window and sprites enabled,
+// scrolls the background from the VBLANK handler and runs a mixed instruction loop in the foreground
+void
+build_benchmark_rom(u8 *rom)
+{
+    memset(rom, 0, ROM_SIZE);
+
+    const u8 vblank_handler[] = {
+        0xF5,             // push af
+        0xF0, 0x43,       // ldh a,(SCX)
+        0x3C,             // inc a
+        0xE0, 0x43,       // ldh (SCX),a
+        0xF0, 0x42,       // ldh a,(SCY)
+        0x3D,             // dec a
+        0xE0, 0x42,       // ldh (SCY),a
+        0xF1,             // pop af
+        0xD9,             // reti
+    };
+
+    const u8 entry[] = {
+        0x00,             // nop
+        0xC3, 0x50, 0x01, // jp 0x0150
+    };
+
+    const u8 program[] = {
+        0x31, 0xF0, 0xDF, // ld sp,0xDFF0
+        0x3E, 0xF3,       // ld a,0xF3 (LCD, window, 8000 tile data, sprites, background)
+        0xE0, 0x40,       // ldh (LCDC),a
+        0x3E, 0x01,       // ld a,VBLANK
+        0xE0, 0xFF,       // ldh (IE),a
+        0x3E, 0x0A,       // ld a,0x0A
+        0xEA, 0x00, 0x00, // ld (0x0000),a enable cartridge RAM
+        0xFB,             // ei
+        0x21, 0x00, 0xC0, // ld hl,0xC000
+        // loop: 0x0164
+        0x7E,             // ld a,(hl)
+        0x80,             // add a,b
+        0x04,             // inc b
+        0x22,             // ld (hl+),a
+        0xA9,             // xor c
+        0xC5,             // push bc
+        0xD1,             // pop de
+        0xCD, 0x80, 0x01, // call 0x0180
+        0xCB, 0x5F,       // bit 3,a
+        0xCB, 0x11,       // rl c
+        0x7C,             // ld a,h
+        0xFE, 0xC1,       // cp 0xC1
+        0x20, 0x03,       // jr nz,+3
+        0x21, 0x00, 0xC0, // ld hl,0xC000
+        0xC3, 0x64, 0x01, // jp 0x0164
+    };
+
+    const u8 subroutine[] = {
+        0x0C,             // inc c
+        0x73,             // ld (hl),e
+        0xC9,             // ret
+    };
+
+    memcpy(rom + 0x0040, vblank_handler, sizeof(vblank_handler));
+    memcpy(rom + 0x0100, entry, sizeof(entry));
+    memcpy(rom + 0x0150, program, sizeof(program));
+    memcpy(rom + 0x0180, subroutine, sizeof(subroutine));
+
+    memcpy(rom + 0x0134, "BENCHMARK", 9);
+    rom[0x0147] = 0x03; // MBC1 + RAM + battery
+
+    for (u64 i = 0x4000; i < ROM_SIZE; ++i)
+    {
+        rom[i] = static_cast<u8>(i * 13);
+    }
+}
+
+GameBoy *
+create_gameboy(u8 *rom, u64 size = ROM_SIZE)
+{
+    GameBoy *gb = new GameBoy();
+    cartridge_load(&gb->memory_bus.cartridge, rom, size);
+    gameboy_init(gb);
+    return gb;
+}
+
+// Tiles, maps, palettes and 40 sprites spread over the screen so every pixel path in the PPU is taken
+void
+setup_video_state(Memory_Bus *memory_bus)
+{
+    for (u16 address = 0x8000; address < 0x9800; ++address)
+    {
+        memory_bus->write_u8(address, static_cast<u8>(address * 7));
+    }
+
+    for (u16 address = 0x9800; address < 0xA000; ++address)
+    {
+        memory_bus->write_u8(address, static_cast<u8>(address * 3));
+    }
+
+    for (u8 sprite = 0; sprite < 40; ++sprite)
+    {
+        u16 address = 0xFE00 + sprite * 4;
+        memory_bus->write_u8(address, 16 + (sprite * 13) % 144);
+        memory_bus->write_u8(address + 1, 8 + (sprite * 37) % 160);
+        memory_bus->write_u8(address + 2, sprite * 5);
+        memory_bus->write_u8(address + 3, (sprite & 0x07) << 4);
+    }
+
+    memory_bus->write_u8(0xFF47, 0xE4); // BGP
+    memory_bus->write_u8(0xFF48, 0xD2); // OBP0
+    memory_bus->write_u8(0xFF49, 0x1B); // OBP1
+    memory_bus->write_u8(0xFF4A, 100); // WY
+    memory_bus->write_u8(0xFF4B, 87); // WX
+    memory_bus->write_u8(0xFF40, 0xF3); // LCDC
+}
+
+template <typename Workload>
+double
+measure(u32 repeat, Workload workload)
+{
+    double best = 0.0;
+
+    for (u32 i = 0; i < repeat; ++i)
+    {
+        auto start = std::chrono::steady_clock::now();
+        workload();
+        auto end = std::chrono::steady_clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+        if (i == 0 || ns < best)
+        {
+            best = ns;
+        }
+    }
+
+    return best;
+}
+
+Benchmark_Result
+benchmark_cpu_mix(u8 *rom, u32 repeat)
+{
+    GameBoy *gb = create_gameboy(rom);
+
+    double ns = measure(repeat, [gb]()
+    {
+        for (u64 i = 0; i < CPU_MIX_CYCLES; ++i)
+        {
+            cpu_cycle(&gb->cpu, &gb->memory_bus);
+        }
+    });
+
+    delete gb;
+    return {"cpu_instruction_mix", CPU_MIX_CYCLES, CPU_MIX_CYCLES, ns};
+}
+
+Benchmark_Result
+benchmark_ppu_frame(u8 *rom, u32 repeat)
+{
+    GameBoy *gb = create_gameboy(rom);
+    setup_video_state(&gb->memory_bus);
+
+    double ns = measure(repeat, [gb]()
+    {
+        for (u64 i = 0; i < PPU_FRAMES * CYCLES_PER_FRAME; ++i)
+        {
+            ppu_cycle<false, false>(&gb->ppu, &gb->memory_bus);
+        }
+    });
+
+    delete gb;
+    return {"ppu_full_frame", PPU_FRAMES * CYCLES_PER_FRAME, PPU_FRAMES * CYCLES_PER_FRAME, ns};
+}
+
+// A loading screen: the LCD is off while the CPU copies data around
+Benchmark_Result
+benchmark_lcd_off_frames(u8 *rom, u32 repeat)
+{
+    GameBoy *gb = create_gameboy(rom);
+    setup_video_state(&gb->memory_bus);
+
+    // Past the ROM's own LCDC write
+    gameboy_run_cycles(gb, CYCLES_PER_FRAME);
+    gb->memory_bus.write_u8(0xFF40, 0x00); // LCDC
+
+    double ns = measure(repeat, [gb]()
+    {
+        for (u64 i = 0; i < LCD_OFF_FRAMES; ++i)
+        {
+            gameboy_run_cycles(gb, CYCLES_PER_FRAME);
+        }
+
+        apu_end_block(&gb->apu, gb->memory_bus.cycles);
+    });
+
+    delete gb;
+    return {"lcd_off_frames", LCD_OFF_FRAMES, LCD_OFF_FRAMES * CYCLES_PER_FRAME, ns};
+}
+
+Benchmark_Result
+benchmark_bus_storm(u8 *rom, u32 repeat)
+{
+    GameBoy *gb = create_gameboy(rom);
+    Memory_Bus *memory_bus = &gb->memory_bus;
+
+    memory_bus->write_u8(0x0000, 0x0A); // enable cartridge RAM
+
+    struct Region
+    {
+        u16 base;
+        u16 mask;
+        u8 value_mask;
+        bool writable;
+    };
+
+    // Every region of the memory map, the two ROM write regions exercise bank switching. Their values
+    // are masked so the selected bank stays within the 8 banks of the ROM, the bus does not bound it
+    const Region regions[] = {
+        {0x0000, 0x3FFF, 0xFF, false},
+        {0x4000, 0x3FFF, 0xFF, false},
+        {0x2000, 0x1FFF, 0x07, true},
+        {0x4000, 0x1FFF, 0x1F, true},
+        {0x8000, 0x1FFF, 0xFF, true},
+        {0xA000, 0x1FFF, 0xFF, true},
+        {0xC000, 0x1FFF, 0xFF, true},
+        {0xE000, 0x1DFF, 0xFF, true},
+        {0xFE00, 0x009F, 0xFF, true},
+        {0xFF00, 0x0000, 0xFF, true},
+        {0xFF10, 0x0016, 0xFF, true},
+        {0xFF40, 0x000B, 0xFF, false},
+        {0xFF80, 0x007E, 0xFF, true},
+    };
+
+    constexpr u64 REGION_COUNT = sizeof(regions) / sizeof(regions[0]);
+    u64 operations = 0;
+
+    for (const Region &region : regions)
+    {
+        operations += BUS_STORM_ITERATIONS * (region.writable ? 2 : 1);
+    }
+
+    volatile u8 sink = 0;
+
+    double ns = measure(repeat, [memory_bus, &regions, &sink]()
+    {
+        u8 accumulator = 0;
+
+        for (u64 r = 0; r < REGION_COUNT; ++r)
+        {
+            const Region &region = regions[r];
+
+            for (u64 i = 0; i < BUS_STORM_ITERATIONS; ++i)
+            {
+                u16 address = region.base + static_cast<u16>((i * 97) & region.mask);
+
+                if (region.writable)
+                {
+                    memory_bus->write_u8(address, static_cast<u8>(i) & region.value_mask);
+                }
+
+                accumulator += memory_bus->read_u8(address);
+            }
+        }
+
+        sink = accumulator;
+    });
+
+    delete gb;
+    return {"memory_bus_storm", operations, 0, ns};
+}
+
+Benchmark_Result
+benchmark_timers(u8 *rom, u32 repeat)
+{
+    GameBoy *gb = create_gameboy(rom);
+    gb->memory_bus.write_u8(TAC, 0x05); // enabled, fastest clock
+
+    double ns = measure(repeat, [gb]()
+    {
+        for (u64 i = 0; i < TIMER_CYCLES; ++i)
+        {
+            timers_cycle(&gb->timers, &gb->memory_bus);
+        }
+    });
+
+    delete gb;
+    return {"timers_cycle", TIMER_CYCLES, TIMER_CYCLES, ns};
+}
+
+Benchmark_Result
+benchmark_system_frames(u8 *rom, u32 repeat)
+{
+    GameBoy *gb = create_gameboy(rom);
+    setup_video_state(&gb->memory_bus);
+
+    double ns = measure(repeat, [gb]()
+    {
+        for (u64 i = 0; i < SYSTEM_FRAMES; ++i)
+        {
+            gameboy_run_cycles(gb, CYCLES_PER_FRAME);
+        }
+
+        apu_end_block(&gb->apu, gb->memory_bus.cycles);
+    });
+
+    delete gb;
+    return {"system_frames", SYSTEM_FRAMES, SYSTEM_FRAMES * CYCLES_PER_FRAME, ns};
+}
+
+// The system frames again with nothing drawn, as a bot that never looks at the screen runs
+Benchmark_Result
+benchmark_skipped_frames(u8 *rom, u32 repeat)
+{
+    GameBoy *gb = create_gameboy(rom);
+    setup_video_state(&gb->memory_bus);
+    gb->ppu.frame_skip = FRAME_SKIP_ALL;
+
+    double ns = measure(repeat, [gb]()
+    {
+        for (u64 i = 0; i < SKIPPED_FRAMES; ++i)
+        {
+            gameboy_run_cycles(gb, CYCLES_PER_FRAME);
+        }
+
+        apu_end_block(&gb->apu, gb->memory_bus.cycles);
+    });
+
+    delete gb;
+    return {"skipped_frames", SKIPPED_FRAMES, SKIPPED_FRAMES * CYCLES_PER_FRAME, ns};
+}
+
+// The system frames again with lines drawn on the render thread
+Benchmark_Result
+benchmark_render_thread_frames(u8 *rom, u32 repeat)
+{
+    GameBoy *gb = create_gameboy(rom);
+    setup_video_state(&gb->memory_bus);
+    ppu_start_renderer(&gb->ppu, &gb->memory_bus);
+
+    double ns = measure(repeat, [gb]()
+    {
+        for (u64 i = 0; i < SYSTEM_FRAMES; ++i)
+        {
+            gameboy_run_cycles(gb, CYCLES_PER_FRAME);
+        }
+
+        apu_end_block(&gb->apu, gb->memory_bus.cycles);
+    });
+
+    ppu_stop_renderer(&gb->ppu);
+
+    delete gb;
+    return {"render_thread_frames", SYSTEM_FRAMES, SYSTEM_FRAMES * CYCLES_PER_FRAME, ns};
+}
+
+// The benchmark ROM with its foreground loop replaced by a wait for VBLANK that polls LY, as most games
+// spend the rest of each frame
+Benchmark_Result
+benchmark_idle_frames(u8 *rom, u32 repeat)
+{
+    const u8 wait_vblank[] = {
+        // loop: 0x0164
+        0xF0, 0x44,       // ldh a,(LY)
+        0xFE, 0x90,       // cp 144
+        0x20, 0xFA,       // jr nz,loop
+        0xF0, 0x44,       // ldh a,(LY)
+        0xFE, 0x90,       // cp 144
+        0x28, 0xFA,       // jr z,0x016A
+        0xC3, 0x64, 0x01, // jp 0x0164
+    };
+
+    u8 *idle_rom = reinterpret_cast<u8*>(malloc(ROM_SIZE));
+    memcpy(idle_rom, rom, ROM_SIZE);
+    memcpy(idle_rom + 0x0164, wait_vblank, sizeof(wait_vblank));
+
+    GameBoy *gb = create_gameboy(idle_rom);
+    setup_video_state(&gb->memory_bus);
+
+    double ns = measure(repeat, [gb]()
+    {
+        for (u64 i = 0; i < IDLE_FRAMES; ++i)
+        {
+            gameboy_run_cycles(gb, CYCLES_PER_FRAME);
+        }
+
+        apu_end_block(&gb->apu, gb->memory_bus.cycles);
+    });
+
+    delete gb;
+    free(idle_rom);
+    return {"idle_wait_frames", IDLE_FRAMES, IDLE_FRAMES * CYCLES_PER_FRAME, ns};
+}
+
+// Aggregate frames per second of a batch stepped by every hardware thread
+Benchmark_Result
+benchmark_batch_frames(u8 *rom, u32 repeat)
+{
+    Batch *batch = batch_create(rom, ROM_SIZE, BATCH_INSTANCES, 0, 2, 1);
+    u8 buttons[BATCH_INSTANCES] = {};
+
+    double ns = measure(repeat, [batch, &buttons]()
+    {
+        for (u64 i = 0; i < BATCH_STEPS; ++i)
+        {
+            batch_step(batch, buttons);
+        }
+    });
+
+    batch_destroy(batch);
+
+    u64 frames = BATCH_INSTANCES * BATCH_STEPS;
+    return {"batch_frames", frames, frames * CYCLES_PER_FRAME, ns};
+}
+
+// Plays a recorded movie from power on to its end, every repeat starts from a fresh GameBoy
+bool
+benchmark_movie_replay(char *rom_path, char *movie_path, u32 repeat, Benchmark_Result *result)
+{
+    u64 size;
+    u8 *rom = read_file(rom_path, &size);
+
+    if (!rom)
+    {
+        printf("Unable to read %s\n", rom_path);
+        return false;
+    }
+
+    u64 end_cycle = 0;
+    bool matched = true;
+
+    double ns = measure(repeat, [rom, size, movie_path, &end_cycle, &matched]()
+    {
+        GameBoy *gb = create_gameboy(rom, size);
+
+        // A movie that was never closed has no END event, and so no length to replay
+        if (movie_play(&gb->movie, movie_path, &gb->memory_bus.cartridge) && !gb->movie.events.empty() &&
+            gb->movie.events.back().type == Movie_Event::Type::END)
+        {
+            end_cycle = gb->movie.events.back().cycle;
+            movie_run_cycles(&gb->movie, gb, end_cycle);
+            matched &= gb->movie.checkpoints_failed == 0;
+        }
+
+        delete gb;
+    });
+
+    free(rom);
+
+    if (!end_cycle)
+    {
+        printf("Unable to replay %s\n", movie_path);
+        return false;
+    }
+
+    if (!matched)
+    {
+        printf("Movie replay diverged, timings are not comparable\n");
+    }
+
+    *result = {"movie_replay", (end_cycle + CYCLES_PER_FRAME - 1) / CYCLES_PER_FRAME, end_cycle, ns};
+    return true;
+}
+
+double
+emulated_mhz(Benchmark_Result *result)
+{
+    return result->emulated_cycles ? result->emulated_cycles / (result->best_ns / 1e9) / 1e6 : 0.0;
+}
+
+bool
+write_json(char *path, std::vector<Benchmark_Result> &results, u32 repeat)
+{
+    FILE *file = fopen(path, "w");
+
+    if (!file)
+    {
+        printf("Unable to write %s\n", path);
+        return false;
+    }
+
+    fprintf(file, "{\n  \"repeat\": %u,\n  \"benchmarks\": [\n", repeat);
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        Benchmark_Result *result = &results[i];
+
+        fprintf(file, "    {\"name\": \"%s\", \"operations\": %llu, \"best_ns\": %.0f, \"ns_per_op\": %.3f, \"emulated_mhz\": %.3f}%s\n",
+            result->name,
+            static_cast<unsigned long long>(result->operations),
+            result->best_ns,
+            result->best_ns / result->operations,
+            emulated_mhz(result),
+            i + 1 < results.size() ? "," : "");
+    }
+
+    fprintf(file, "  ]\n}\n");
+    fclose(file);
+
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    u32 repeat = 5;
+    char *json_path = NULL;
+    char *filter = NULL;
+    char *rom_path = NULL;
+    char *movie_path = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--repeat") == 0 && i + 1 < argc)
+        {
+            repeat = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            json_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--rom") == 0 && i + 1 < argc)
+        {
+            rom_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--movie") == 0 && i + 1 < argc)
+        {
+            movie_path = argv[++i];
+        }
+        else
+        {
+            printf("Usage: bench [--repeat n] [--json file] [--filter name] [--rom file --movie file]\n");
+            return 1;
+        }
+    }
+
+    if (repeat == 0)
+    {
+        repeat = 1;
+    }
+
+    u8 *rom = reinterpret_cast<u8*>(malloc(ROM_SIZE));
+    build_benchmark_rom(rom);
+
+    typedef Benchmark_Result (*Benchmark)(u8 *rom, u32 repeat);
+
+    const Benchmark benchmarks[] = {
+        benchmark_cpu_mix,
+        benchmark_ppu_frame,
+        benchmark_lcd_off_frames,
+        benchmark_bus_storm,
+        benchmark_timers,
+        benchmark_system_frames,
+        benchmark_skipped_frames,
+        benchmark_render_thread_frames,
+        benchmark_idle_frames,
+        benchmark_batch_frames,
+    };
+
+    const char *names[] = {"cpu_instruction_mix", "ppu_full_frame", "lcd_off_frames", "memory_bus_storm", "timers_cycle", "system_frames", "skipped_frames", "render_thread_frames", "idle_wait_frames", "batch_frames"};
+
+    std::vector<Benchmark_Result> results;
+
+    for (u32 i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); ++i)
+    {
+        if (filter && !strstr(names[i], filter))
+        {
+            continue;
+        }
+
+        results.push_back(benchmarks[i](rom, repeat));
+    }
+
+    if (rom_path && movie_path)
+    {
+        Benchmark_Result result;
+
+        if (benchmark_movie_replay(rom_path, movie_path, repeat, &result))
+        {
+            results.push_back(result);
+        }
+    }
+
+    printf("\n%-22s %14s %12s %14s\n", "benchmark", "operations", "ns/op", "emulated MHz");
+
+    for (Benchmark_Result &result : results)
+    {
+        printf("%-22s %14llu %12.3f %14.3f\n", result.name, static_cast<unsigned long long>(result.operations), result.best_ns / result.operations, emulated_mhz(&result));
+    }
+
+    if (json_path && !write_json(json_path, results, repeat))
+    {
+        return 1;
+    }
+
+    free(rom);
+    return 0;
+}
@@ -8,12 +8,40 @@ if not exist ".\build" mkdir .\build
 if not exist ".\bin" mkdir .\bin
 
 set FLAGS=/Fe: ./bin/emulator.exe /Fo"build\\" /Fd"build\\" /std:c++latest /EHsc /FC /Zi /Zc:strictStrings-
+set CONFIG_FLAGS=/DEMULATOR_TRACE
 set LIBS=user32.lib gdi32.lib
 FOR /F "tokens=*" %%g in ('dir /s/b .\src\*.cpp') do (set "CPP=!CPP! %%g")
 
 IF "%1"=="/t" (
     set FLAGS=/Fe: ./bin/test.exe /Fo"build\\" /Fd"build\\" /std:c++latest /EHsc /FC /Zi /I%~dp0src /I%~dp0test
-    set CPP=test/main.cpp test/memory_bus.cpp src/cpu.cpp src/joypad.cpp src/ppu.cpp src/timers.cpp src/emulator.cpp src/win32.cpp
+    set CONFIG_FLAGS=
+    set CPP=test/main.cpp test/memory_bus.cpp src/cpu.cpp src/joypad.cpp src/ppu.cpp src/timers.cpp src/apu.cpp src/audio.cpp src/profiler.cpp src/trace.cpp src/emulator.cpp src/gameboy.cpp src/hash.cpp src/lockstep.cpp src/movie.cpp src/video.cpp src/dump.cpp src/win32.cpp
 )
 
-cl %CPP% %LIBS% %FLAGS%
\ No newline at end of file
+IF "%1"=="/b" (
+    set FLAGS=/Fe: ./bin/bench.exe /Fo"build\\" /Fd"build\\" /std:c++latest /EHsc /FC /Zi /I%~dp0src
+    set CONFIG_FLAGS=/O2
+    set CPP=bench/main.cpp !CPP!
+)
+
+IF "%1"=="/g" (
+    set FLAGS=/Fe: ./bin/golden.exe /Fo"build\\" /Fd"build\\" /std:c++latest /EHsc /FC /Zi /I%~dp0src
+    set CONFIG_FLAGS=/O2
+    set CPP=test/golden/main.cpp !CPP!
+)
+
+IF "%1"=="/e" (
+    set FLAGS=/Fe: ./bin/equivalence.exe /Fo"build\\" /Fd"build\\" /std:c++latest /EHsc /FC /Zi /I%~dp0src
+    set CONFIG_FLAGS=/O2
+    set CPP=test/equivalence/main.cpp !CPP!
+)
+
+IF "%1"=="/r" (
+    set CONFIG_FLAGS=/O2
+)
+
+IF "%1"=="/p" (
+    set CONFIG_FLAGS=/O2 /DEMULATOR_PROFILE
+)
+
+cl %CPP% %LIBS% %FLAGS% %CONFIG_FLAGS%
\ No newline at end of file
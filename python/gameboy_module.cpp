@@ -0,0 +1,807 @@
+#define PY_SSIZE_T_CLEAN
+#include <Python.h>
+
+#include "emulator.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+struct GameBoy_Object
+{
+    PyObject_HEAD
+    GameBoy *gb;
+    u8 *rom;
+    u8 *observation; // NULL until observe is called
+    bool running; // set while the GIL is released inside an emulation call
+    bool memory_exported; // a writable memory view was handed out, see sync_memory
+};
+
+// Exports a region of a GameBoy or Batch through the buffer protocol and keeps the owner alive, so
+// numpy.asarray on it is a zero copy view that follows the emulator as it runs
+struct View_Object
+{
+    PyObject_HEAD
+    PyObject *owner;
+    void *data;
+    const char *format;
+    Py_ssize_t item_size;
+    int ndim;
+    Py_ssize_t shape[4];
+    Py_ssize_t strides[4];
+    bool readonly;
+};
+
+struct Batch_Object
+{
+    PyObject_HEAD
+    Batch *batch;
+    u8 *rom;
+    bool running;
+};
+
+static PyTypeObject View_Type = {PyVarObject_HEAD_INIT(NULL, 0)};
+static PyTypeObject GameBoy_Type = {PyVarObject_HEAD_INIT(NULL, 0)};
+static PyTypeObject Batch_Type = {PyVarObject_HEAD_INIT(NULL, 0)};
+
+static int
+view_get_buffer(PyObject *object, Py_buffer *buffer, int flags)
+{
+    View_Object *view = reinterpret_cast<View_Object*>(object);
+
+    if ((flags & PyBUF_WRITABLE) && view->readonly)
+    {
+        PyErr_SetString(PyExc_BufferError, "view is read only");
+        buffer->obj = NULL;
+        return -1;
+    }
+
+    Py_ssize_t count = 1;
+
+    for (int i = 0; i < view->ndim; ++i)
+    {
+        count *= view->shape[i];
+    }
+
+    buffer->buf = view->data;
+    buffer->obj = object;
+    buffer->len = count * view->item_size;
+    buffer->readonly = view->readonly;
+    buffer->itemsize = view->item_size;
+    buffer->format = (flags & PyBUF_FORMAT) ? const_cast<char*>(view->format) : NULL;
+    buffer->ndim = view->ndim;
+    buffer->shape = (flags & PyBUF_ND) ? view->shape : NULL;
+    buffer->strides = (flags & PyBUF_STRIDES) == PyBUF_STRIDES ? view->strides : NULL;
+    buffer->suboffsets = NULL;
+    buffer->internal = NULL;
+
+    Py_INCREF(object);
+    return 0;
+}
+
+static void
+view_dealloc(PyObject *object)
+{
+    View_Object *view = reinterpret_cast<View_Object*>(object);
+    Py_XDECREF(view->owner);
+    Py_TYPE(object)->tp_free(object);
+}
+
+static PyBufferProcs view_buffer_procs = {view_get_buffer, NULL};
+
+// C contiguous view of up to four dimensions
+static PyObject *
+create_view(PyObject *owner, void *data, const char *format, Py_ssize_t item_size, int ndim, const Py_ssize_t *shape, bool readonly)
+{
+    View_Object *view = PyObject_New(View_Object, &View_Type);
+
+    if (!view)
+    {
+        return NULL;
+    }
+
+    Py_INCREF(owner);
+    view->owner = owner;
+    view->data = data;
+    view->format = format;
+    view->item_size = item_size;
+    view->ndim = ndim;
+    view->readonly = readonly;
+
+    Py_ssize_t stride = item_size;
+
+    for (int i = ndim - 1; i >= 0; --i)
+    {
+        view->shape[i] = shape[i];
+        view->strides[i] = stride;
+        stride *= shape[i];
+    }
+
+    PyObject *memory_view = PyMemoryView_FromObject(reinterpret_cast<PyObject*>(view));
+    Py_DECREF(view);
+
+    return memory_view;
+}
+
+static bool
+check_initialised(GameBoy_Object *self)
+{
+    if (!self->gb)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "GameBoy is not initialised");
+        return false;
+    }
+
+    return true;
+}
+
+static bool
+check_ready(GameBoy_Object *self)
+{
+    if (!check_initialised(self))
+    {
+        return false;
+    }
+
+    if (self->running)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "GameBoy is already running on another thread");
+        return false;
+    }
+
+    return true;
+}
+
+// Writes through the memory view bypass the bus, so before emulating re-derive what the bus would
+// have updated: the pending interrupt mask from IF and IE and the PPU caches of VRAM and OAM
+static void
+sync_memory(GameBoy_Object *self)
+{
+    if (!self->memory_exported)
+    {
+        return;
+    }
+
+    memory_bus_update_interrupts(&self->gb->memory_bus);
+    ppu_invalidate_caches(&self->gb->ppu, &self->gb->memory_bus);
+}
+
+static u8 *
+read_rom(PyObject *rom, u64 *size)
+{
+    if (PyUnicode_Check(rom))
+    {
+        const char *path = PyUnicode_AsUTF8(rom);
+        FILE *file = path ? fopen(path, "rb") : NULL;
+
+        if (!file)
+        {
+            PyErr_Format(PyExc_FileNotFoundError, "unable to open %s", path);
+            return NULL;
+        }
+
+        fseek(file, 0, SEEK_END);
+        *size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+
+        u8 *data = reinterpret_cast<u8*>(malloc(*size));
+        u64 read = fread(data, 1, *size, file);
+        fclose(file);
+
+        if (read != *size)
+        {
+            free(data);
+            PyErr_Format(PyExc_IOError, "unable to read %s", path);
+            return NULL;
+        }
+
+        return data;
+    }
+
+    Py_buffer buffer;
+
+    if (PyObject_GetBuffer(rom, &buffer, PyBUF_SIMPLE) != 0)
+    {
+        return NULL;
+    }
+
+    *size = buffer.len;
+    u8 *data = reinterpret_cast<u8*>(malloc(*size));
+    memcpy(data, buffer.buf, *size);
+    PyBuffer_Release(&buffer);
+
+    return data;
+}
+
+static int
+gameboy_object_init(PyObject *object, PyObject *args, PyObject *kwargs)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+    static const char *keywords[] = {"rom", NULL};
+    PyObject *rom;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "O", const_cast<char**>(keywords), &rom))
+    {
+        return -1;
+    }
+
+    // Views of the memory, frame buffer and observation, and a step running on another thread, would
+    // be left pointing at a freed GameBoy
+    if (self->gb)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "GameBoy is already initialised");
+        return -1;
+    }
+
+    u64 size = 0;
+    u8 *data = read_rom(rom, &size);
+
+    if (!data)
+    {
+        return -1;
+    }
+
+    // Reads from 0x0000-0x7FFF assume both 16KB banks are present
+    if (size < 0x8000)
+    {
+        free(data);
+        PyErr_SetString(PyExc_ValueError, "ROM is smaller than 32KB");
+        return -1;
+    }
+
+    GameBoy *gb = new GameBoy();
+
+    if (!cartridge_load(&gb->memory_bus.cartridge, data, size))
+    {
+        delete gb;
+        free(data);
+        PyErr_SetString(PyExc_ValueError, "CGB only ROMs are not supported");
+        return -1;
+    }
+
+    gameboy_init(gb);
+
+    self->gb = gb;
+    self->rom = data;
+    self->observation = NULL;
+    self->running = false;
+    self->memory_exported = false;
+
+    return 0;
+}
+
+static void
+gameboy_object_dealloc(PyObject *object)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+
+    delete self->gb;
+    free(self->rom);
+    delete[] self->observation;
+
+    Py_TYPE(object)->tp_free(object);
+}
+
+static PyObject *
+gameboy_step(PyObject *object, PyObject *args, PyObject *kwargs)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+    static const char *keywords[] = {"frames", "buttons", NULL};
+    unsigned int frames = 1;
+    unsigned char buttons = 0;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|Ib", const_cast<char**>(keywords), &frames, &buttons) || !check_ready(self))
+    {
+        return NULL;
+    }
+
+    sync_memory(self);
+
+    GameBoy *gb = self->gb;
+    self->running = true;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    joypad_set_buttons(&gb->memory_bus, buttons);
+
+    for (unsigned int i = 0; i < frames; ++i)
+    {
+        gameboy_run_frame(gb);
+    }
+
+    apu_end_block(&gb->apu, gb->memory_bus.cycles);
+
+    Py_END_ALLOW_THREADS
+
+    self->running = false;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+gameboy_run_cycles_method(PyObject *object, PyObject *args)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+    unsigned long long cycles;
+
+    if (!PyArg_ParseTuple(args, "K", &cycles) || !check_ready(self))
+    {
+        return NULL;
+    }
+
+    sync_memory(self);
+
+    GameBoy *gb = self->gb;
+    self->running = true;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    gameboy_run_cycles(gb, cycles);
+    apu_end_block(&gb->apu, gb->memory_bus.cycles);
+
+    Py_END_ALLOW_THREADS
+
+    self->running = false;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+gameboy_save_state_method(PyObject *object, PyObject *)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+
+    if (!check_ready(self))
+    {
+        return NULL;
+    }
+
+    sync_memory(self);
+
+    u64 size = gameboy_save_state(self->gb, NULL, 0);
+    PyObject *state = PyBytes_FromStringAndSize(NULL, size);
+
+    if (state)
+    {
+        gameboy_save_state(self->gb, reinterpret_cast<u8*>(PyBytes_AS_STRING(state)), size);
+    }
+
+    return state;
+}
+
+static PyObject *
+gameboy_load_state_method(PyObject *object, PyObject *args)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+    Py_buffer buffer;
+
+    if (!check_ready(self) || !PyArg_ParseTuple(args, "y*", &buffer))
+    {
+        return NULL;
+    }
+
+    bool loaded = gameboy_load_state(self->gb, reinterpret_cast<u8*>(buffer.buf), buffer.len);
+    PyBuffer_Release(&buffer);
+
+    if (!loaded)
+    {
+        PyErr_SetString(PyExc_ValueError, "state does not belong to this ROM or version");
+        return NULL;
+    }
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+gameboy_get_frame_buffer(PyObject *object, void *)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+
+    if (!check_initialised(self))
+    {
+        return NULL;
+    }
+
+    const Py_ssize_t shape[] = {GAMEBOY_HEIGHT, GAMEBOY_WIDTH};
+    return create_view(object, self->gb->ppu.frame_buffer, "B", sizeof(u8), 2, shape, true);
+}
+
+static PyObject *
+gameboy_observe(PyObject *object, PyObject *args, PyObject *kwargs)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+    static const char *keywords[] = {"downscale", "stack", NULL};
+    unsigned char downscale = 2;
+    unsigned char stack = 1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "|bb", const_cast<char**>(keywords), &downscale, &stack) || !check_ready(self))
+    {
+        return NULL;
+    }
+
+    // Views of the observation would be left pointing at a freed buffer
+    if (self->observation)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "observe can only be called once");
+        return NULL;
+    }
+
+    if (downscale == 0 || stack == 0 || GAMEBOY_WIDTH % downscale || GAMEBOY_HEIGHT % downscale)
+    {
+        PyErr_SetString(PyExc_ValueError, "downscale must divide 160 and 144 and stack must be at least 1");
+        return NULL;
+    }
+
+    u8 *observation = new u8[stack * (GAMEBOY_WIDTH / downscale) * (GAMEBOY_HEIGHT / downscale)]();
+    ppu_set_observation(&self->gb->ppu, observation, downscale, stack);
+    self->observation = observation;
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+gameboy_get_observation(PyObject *object, void *)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+
+    if (!check_initialised(self))
+    {
+        return NULL;
+    }
+
+    if (!self->observation)
+    {
+        Py_RETURN_NONE;
+    }
+
+    PPU *ppu = &self->gb->ppu;
+    Py_ssize_t height = GAMEBOY_HEIGHT / ppu->observation_downscale;
+    Py_ssize_t width = GAMEBOY_WIDTH / ppu->observation_downscale;
+
+    if (ppu->observation_stack == 1)
+    {
+        const Py_ssize_t shape[] = {height, width};
+        return create_view(object, self->observation, "B", sizeof(u8), 2, shape, true);
+    }
+
+    const Py_ssize_t shape[] = {ppu->observation_stack, height, width};
+    return create_view(object, self->observation, "B", sizeof(u8), 3, shape, true);
+}
+
+static PyObject *
+gameboy_get_memory(PyObject *object, void *)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+
+    if (!check_initialised(self))
+    {
+        return NULL;
+    }
+
+    self->memory_exported = true;
+
+    const Py_ssize_t shape[] = {sizeof(self->gb->memory_bus.memory)};
+    return create_view(object, self->gb->memory_bus.memory, "B", sizeof(u8), 1, shape, false);
+}
+
+static PyObject *
+gameboy_get_cycles(PyObject *object, void *)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+
+    if (!check_initialised(self))
+    {
+        return NULL;
+    }
+
+    return PyLong_FromUnsignedLongLong(self->gb->memory_bus.cycles);
+}
+
+static PyObject *
+gameboy_get_frame_count(PyObject *object, void *)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+
+    if (!check_initialised(self))
+    {
+        return NULL;
+    }
+
+    return PyLong_FromUnsignedLongLong(self->gb->ppu.frame_count);
+}
+
+static PyObject *
+gameboy_get_frame_skip(PyObject *object, void *)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+
+    if (!check_initialised(self))
+    {
+        return NULL;
+    }
+
+    u32 frame_skip = self->gb->ppu.frame_skip;
+    return PyLong_FromLong(frame_skip == FRAME_SKIP_ALL ? -1 : static_cast<long>(frame_skip));
+}
+
+static int
+gameboy_set_frame_skip(PyObject *object, PyObject *value, void *)
+{
+    GameBoy_Object *self = reinterpret_cast<GameBoy_Object*>(object);
+
+    if (!check_initialised(self))
+    {
+        return -1;
+    }
+
+    if (!value)
+    {
+        PyErr_SetString(PyExc_TypeError, "frame_skip cannot be deleted");
+        return -1;
+    }
+
+    long frame_skip = PyLong_AsLong(value);
+
+    if (frame_skip == -1 && PyErr_Occurred())
+    {
+        return -1;
+    }
+
+    if (frame_skip < -1 || frame_skip >= static_cast<long>(FRAME_SKIP_ALL))
+    {
+        PyErr_SetString(PyExc_ValueError, "frame_skip must be -1 or a frame count");
+        return -1;
+    }
+
+    self->gb->ppu.frame_skip = frame_skip == -1 ? FRAME_SKIP_ALL : static_cast<u32>(frame_skip);
+    return 0;
+}
+
+static PyMethodDef gameboy_methods[] = {
+    {"step", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(gameboy_step)), METH_VARARGS | METH_KEYWORDS,
+        "step(frames=1, buttons=0)\nHold buttons (a mask of the BUTTON_* constants) and run frames frames with the GIL released."},
+    {"observe", reinterpret_cast<PyCFunction>(reinterpret_cast<void(*)(void)>(gameboy_observe)), METH_VARARGS | METH_KEYWORDS,
+        "observe(downscale=2, stack=1)\nHave the PPU write a grayscale observation averaged over downscale x downscale blocks as it draws, keeping the last stack frames."},
+    {"run_cycles", gameboy_run_cycles_method, METH_VARARGS,
+        "run_cycles(cycles)\nRun a number of T-cycles with the GIL released."},
+    {"save_state", gameboy_save_state_method, METH_NOARGS,
+        "save_state() -> bytes\nRun to the next instruction boundary and return the emulator state."},
+    {"load_state", gameboy_load_state_method, METH_VARARGS,
+        "load_state(state)\nRestore a state returned by save_state for the same ROM."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef gameboy_getset[] = {
+    {"frame_buffer", gameboy_get_frame_buffer, NULL, "Read only (144, 160) uint8 view of the frame buffer, shades 0 (white) to 3 (black)", NULL},
+    {"observation", gameboy_get_observation, NULL,
+        "Read only (height, width) uint8 grayscale view written by the PPU, (stack, height, width) oldest first when stacking. None until observe is called", NULL},
+    {"memory", gameboy_get_memory, NULL, "Writable 65536 byte view of Memory_Bus::memory. Writes bypass the bus, so once the view has been taken every step, run_cycles and save_state first resyncs interrupts and the PPU caches with it", NULL},
+    {"cycles", gameboy_get_cycles, NULL, "T-cycles since power on", NULL},
+    {"frame_count", gameboy_get_frame_count, NULL, "Frames completed since power on", NULL},
+    {"frame_skip", gameboy_get_frame_skip, gameboy_set_frame_skip,
+        "Frames left undrawn after each drawn one, -1 draws none. Timing is unaffected, frame_buffer keeps the last drawn frame", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static int
+batch_object_init(PyObject *object, PyObject *args, PyObject *kwargs)
+{
+    Batch_Object *self = reinterpret_cast<Batch_Object*>(object);
+    static const char *keywords[] = {"rom", "count", "threads", "downscale", "stack", NULL};
+    PyObject *rom;
+    unsigned int count;
+    unsigned int threads = 0;
+    unsigned char downscale = 2;
+    unsigned char stack = 1;
+
+    if (!PyArg_ParseTupleAndKeywords(args, kwargs, "OI|Ibb", const_cast<char**>(keywords), &rom, &count, &threads, &downscale, &stack))
+    {
+        return -1;
+    }
+
+    // Views of the observations, and a step running on another thread, would be left pointing at a
+    // destroyed Batch
+    if (self->batch)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Batch is already initialised");
+        return -1;
+    }
+
+    u64 size = 0;
+    u8 *data = read_rom(rom, &size);
+
+    if (!data)
+    {
+        return -1;
+    }
+
+    if (size < 0x8000)
+    {
+        free(data);
+        PyErr_SetString(PyExc_ValueError, "ROM is smaller than 32KB");
+        return -1;
+    }
+
+    Batch *batch = batch_create(data, size, count, threads, downscale, stack);
+
+    if (!batch)
+    {
+        free(data);
+        PyErr_SetString(PyExc_ValueError, "count and stack must be positive and downscale must divide 160 and 144, CGB only ROMs are not supported");
+        return -1;
+    }
+
+    self->batch = batch;
+    self->rom = data;
+    self->running = false;
+
+    return 0;
+}
+
+static void
+batch_object_dealloc(PyObject *object)
+{
+    Batch_Object *self = reinterpret_cast<Batch_Object*>(object);
+
+    if (self->batch)
+    {
+        batch_destroy(self->batch);
+    }
+
+    free(self->rom);
+
+    Py_TYPE(object)->tp_free(object);
+}
+
+static bool
+check_batch_ready(Batch_Object *self)
+{
+    if (!self->batch)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Batch is not initialised");
+        return false;
+    }
+
+    if (self->running)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Batch is already running on another thread");
+        return false;
+    }
+
+    return true;
+}
+
+static PyObject *
+batch_step_method(PyObject *object, PyObject *args)
+{
+    Batch_Object *self = reinterpret_cast<Batch_Object*>(object);
+    Py_buffer buttons;
+
+    if (!check_batch_ready(self) || !PyArg_ParseTuple(args, "y*", &buttons))
+    {
+        return NULL;
+    }
+
+    if (buttons.len != self->batch->count)
+    {
+        PyBuffer_Release(&buttons);
+        PyErr_Format(PyExc_ValueError, "expected %u button masks", self->batch->count);
+        return NULL;
+    }
+
+    Batch *batch = self->batch;
+    u8 *masks = reinterpret_cast<u8*>(buttons.buf);
+    self->running = true;
+
+    Py_BEGIN_ALLOW_THREADS
+
+    batch_step(batch, masks);
+
+    Py_END_ALLOW_THREADS
+
+    self->running = false;
+    PyBuffer_Release(&buttons);
+
+    Py_RETURN_NONE;
+}
+
+static PyObject *
+batch_get_observations(PyObject *object, void *)
+{
+    Batch_Object *self = reinterpret_cast<Batch_Object*>(object);
+
+    if (!self->batch)
+    {
+        PyErr_SetString(PyExc_RuntimeError, "Batch is not initialised");
+        return NULL;
+    }
+
+    Batch *batch = self->batch;
+
+    if (batch->stack == 1)
+    {
+        const Py_ssize_t shape[] = {batch->count, batch->observation_height, batch->observation_width};
+        return create_view(object, batch->observations, "B", sizeof(u8), 3, shape, true);
+    }
+
+    const Py_ssize_t shape[] = {batch->count, batch->stack, batch->observation_height, batch->observation_width};
+    return create_view(object, batch->observations, "B", sizeof(u8), 4, shape, true);
+}
+
+static PyMethodDef batch_methods[] = {
+    {"step", batch_step_method, METH_VARARGS,
+        "step(buttons)\nAdvance every instance by one frame, buttons is a bytes-like object with one BUTTON_* mask per instance."},
+    {NULL, NULL, 0, NULL}
+};
+
+static PyGetSetDef batch_getset[] = {
+    {"observations", batch_get_observations, NULL, "Read only (count, height, width) uint8 grayscale view, (count, stack, height, width) oldest first when stacking. Rewritten by every step", NULL},
+    {NULL, NULL, NULL, NULL, NULL}
+};
+
+static PyModuleDef gameboy_module = {
+    PyModuleDef_HEAD_INIT,
+    "gameboy",
+    "DMG emulator core. Instances are independent and release the GIL while running.",
+    -1,
+    NULL
+};
+
+PyMODINIT_FUNC
+PyInit_gameboy()
+{
+    View_Type.tp_name = "gameboy.View";
+    View_Type.tp_basicsize = sizeof(View_Object);
+    View_Type.tp_flags = Py_TPFLAGS_DEFAULT;
+    View_Type.tp_dealloc = view_dealloc;
+    View_Type.tp_as_buffer = &view_buffer_procs;
+
+    GameBoy_Type.tp_name = "gameboy.GameBoy";
+    GameBoy_Type.tp_doc = "GameBoy(rom)\nrom is a path or a bytes-like object holding the cartridge.";
+    GameBoy_Type.tp_basicsize = sizeof(GameBoy_Object);
+    GameBoy_Type.tp_flags = Py_TPFLAGS_DEFAULT;
+    GameBoy_Type.tp_new = PyType_GenericNew;
+    GameBoy_Type.tp_init = gameboy_object_init;
+    GameBoy_Type.tp_dealloc = gameboy_object_dealloc;
+    GameBoy_Type.tp_methods = gameboy_methods;
+    GameBoy_Type.tp_getset = gameboy_getset;
+
+    Batch_Type.tp_name = "gameboy.Batch";
+    Batch_Type.tp_doc = "Batch(rom, count, threads=0, downscale=2, stack=1)\ncount instances of one ROM stepped together by a thread pool.";
+    Batch_Type.tp_basicsize = sizeof(Batch_Object);
+    Batch_Type.tp_flags = Py_TPFLAGS_DEFAULT;
+    Batch_Type.tp_new = PyType_GenericNew;
+    Batch_Type.tp_init = batch_object_init;
+    Batch_Type.tp_dealloc = batch_object_dealloc;
+    Batch_Type.tp_methods = batch_methods;
+    Batch_Type.tp_getset = batch_getset;
+
+    if (PyType_Ready(&View_Type) < 0 || PyType_Ready(&GameBoy_Type) < 0 || PyType_Ready(&Batch_Type) < 0)
+    {
+        return NULL;
+    }
+
+    PyObject *module = PyModule_Create(&gameboy_module);
+
+    if (!module)
+    {
+        return NULL;
+    }
+
+    Py_INCREF(&GameBoy_Type);
+    PyModule_AddObject(module, "GameBoy", reinterpret_cast<PyObject*>(&GameBoy_Type));
+
+    Py_INCREF(&Batch_Type);
+    PyModule_AddObject(module, "Batch", reinterpret_cast<PyObject*>(&Batch_Type));
+
+    PyModule_AddIntConstant(module, "BUTTON_A", JOYPAD_A);
+    PyModule_AddIntConstant(module, "BUTTON_B", JOYPAD_B);
+    PyModule_AddIntConstant(module, "BUTTON_SELECT", JOYPAD_SELECT);
+    PyModule_AddIntConstant(module, "BUTTON_START", JOYPAD_START);
+    PyModule_AddIntConstant(module, "BUTTON_RIGHT", JOYPAD_RIGHT);
+    PyModule_AddIntConstant(module, "BUTTON_LEFT", JOYPAD_LEFT);
+    PyModule_AddIntConstant(module, "BUTTON_UP", JOYPAD_UP);
+    PyModule_AddIntConstant(module, "BUTTON_DOWN", JOYPAD_DOWN);
+
+    return module;
+}
@@ -0,0 +1,35 @@
+# Builds the gameboy extension module from the core sources: python setup.py build_ext --inplace
+import glob
+import os
+import sys
+
+from setuptools import Extension, setup
+
+root = os.path.dirname(os.path.abspath(__file__))
+src = os.path.join(root, "..", "src")
+
+# win32.cpp and emulator.cpp are the window application, the module only needs the core
+sources = ["gameboy_module.cpp"] + sorted(
+    os.path.relpath(path, root)
+    for path in glob.glob(os.path.join(src, "*.cpp"))
+    if os.path.basename(path) not in ("win32.cpp", "emulator.cpp")
+)
+
+if sys.platform == "win32":
+    compile_args = ["/std:c++latest", "/EHsc", "/O2", "/Zc:strictStrings-"]
+else:
+    compile_args = ["-std=c++20", "-O2", "-Wno-write-strings"]
+
+setup(
+    name="gameboy",
+    version="0.1",
+    ext_modules=[
+        Extension(
+            "gameboy",
+            sources=sources,
+            include_dirs=[os.path.relpath(src, root)],
+            extra_compile_args=compile_args,
+            language="c++",
+        )
+    ],
+)
@@ -0,0 +1,821 @@
+#include "emulator.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+constexpr u16 NR10 = 0xFF10;
+constexpr u16 NR11 = 0xFF11;
+constexpr u16 NR12 = 0xFF12;
+constexpr u16 NR13 = 0xFF13;
+constexpr u16 NR14 = 0xFF14;
+constexpr u16 NR21 = 0xFF16;
+constexpr u16 NR22 = 0xFF17;
+constexpr u16 NR23 = 0xFF18;
+constexpr u16 NR24 = 0xFF19;
+constexpr u16 NR30 = 0xFF1A;
+constexpr u16 NR31 = 0xFF1B;
+constexpr u16 NR32 = 0xFF1C;
+constexpr u16 NR33 = 0xFF1D;
+constexpr u16 NR34 = 0xFF1E;
+constexpr u16 NR41 = 0xFF20;
+constexpr u16 NR42 = 0xFF21;
+constexpr u16 NR43 = 0xFF22;
+constexpr u16 NR44 = 0xFF23;
+constexpr u16 NR50 = 0xFF24;
+constexpr u16 NR51 = 0xFF25;
+constexpr u16 NR52 = SOUND_CONTROLLER_ON_OF;
+
+constexpr u8 PULSE_1 = 0;
+constexpr u8 PULSE_2 = 1;
+constexpr u8 WAVE = 2;
+constexpr u8 NOISE = 3;
+
+// Bits that always read back as 1 for NR10 - NR52, unused addresses read as 0xFF
+constexpr u8 REGISTER_READ_MASK[] = {
+    0x80, 0x3F, 0x00, 0xFF, 0xBF,
+    0xFF, 0x3F, 0x00, 0xFF, 0xBF,
+    0x7F, 0xFF, 0x9F, 0xFF, 0xBF,
+    0xFF, 0xFF, 0x00, 0x00, 0xBF,
+    0x00, 0x00, 0x70,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+constexpr u8 DUTY_WAVEFORMS[4][8] = {
+    {0, 0, 0, 0, 0, 0, 0, 1}, // 12.5%
+    {1, 0, 0, 0, 0, 0, 0, 1}, // 25%
+    {1, 0, 0, 0, 0, 1, 1, 1}, // 50%
+    {0, 1, 1, 1, 1, 1, 1, 0}, // 75%
+};
+
+constexpr u32 NOISE_DIVISORS[8] = {8, 16, 32, 48, 64, 80, 96, 112};
+
+constexpr u32 FRAME_SEQUENCER_CYCLES = DMG_CLOCK_RATE / 512;
+
+// Maximum mixed amplitude is 4 channels * 15 * 8 master volume * 32 which leaves headroom in an i16
+constexpr i32 AMPLITUDE_SCALE = 32;
+
+constexpr i32 BLIP_DELTA_BITS = 15;
+constexpr i32 BLIP_BASS_SHIFT = 9; // DC blocking high-pass, roughly 16Hz at 44.1kHz
+
+struct Blip_Kernel
+{
+    i16 taps[BLIP_PHASE_COUNT][BLIP_KERNEL_WIDTH];
+};
+
+// Band-limited impulse for each sub-sample phase, the taps of each phase sum to 1 << BLIP_DELTA_BITS
+// so that integrating the buffer reconstructs the original step without aliasing
+Blip_Kernel
+generate_blip_kernel()
+{
+    constexpr double PI = 3.14159265358979323846;
+    constexpr double CUTOFF = 0.9; // fraction of the output nyquist frequency kept
+
+    Blip_Kernel kernel;
+
+    for (u32 phase = 0; phase < BLIP_PHASE_COUNT; ++phase)
+    {
+        double taps[BLIP_KERNEL_WIDTH];
+        double sum = 0.0;
+
+        for (u32 k = 0; k < BLIP_KERNEL_WIDTH; ++k)
+        {
+            double x = static_cast<double>(k) - (BLIP_KERNEL_WIDTH / 2 - 1) - static_cast<double>(phase) / BLIP_PHASE_COUNT;
+            double sinc = x == 0.0 ? 1.0 : std::sin(PI * CUTOFF * x) / (PI * CUTOFF * x);
+            double window = 0.42 + 0.5 * std::cos(2.0 * PI * x / BLIP_KERNEL_WIDTH) + 0.08 * std::cos(4.0 * PI * x / BLIP_KERNEL_WIDTH);
+
+            taps[k] = sinc * window;
+            sum += taps[k];
+        }
+
+        i32 total = 0;
+        u32 largest = 0;
+
+        for (u32 k = 0; k < BLIP_KERNEL_WIDTH; ++k)
+        {
+            kernel.taps[phase][k] = static_cast<i16>(std::lround(taps[k] / sum * (1 << BLIP_DELTA_BITS)));
+            total += kernel.taps[phase][k];
+
+            if (taps[k] > taps[largest])
+            {
+                largest = k;
+            }
+        }
+
+        // Put the rounding error into the centre tap so each phase sums exactly to one
+        kernel.taps[phase][largest] += (1 << BLIP_DELTA_BITS) - total;
+    }
+
+    return kernel;
+}
+
+const Blip_Kernel &
+blip_kernel()
+{
+    static const Blip_Kernel kernel = generate_blip_kernel();
+    return kernel;
+}
+
+void
+blip_init(Blip_Buffer *blip)
+{
+    blip->factor = (static_cast<u64>(AUDIO_SAMPLE_RATE) << 32) / DMG_CLOCK_RATE;
+    blip->offset = 0;
+    blip->integrator = 0;
+    memset(blip->samples, 0, sizeof(blip->samples));
+}
+
+void
+blip_add_delta(Blip_Buffer *blip, u32 time, i32 delta)
+{
+    u64 position = static_cast<u64>(time) * blip->factor + blip->offset;
+    u32 index = static_cast<u32>(position >> 32);
+    u32 phase = static_cast<u32>(position >> (32 - BLIP_PHASE_BITS)) & (BLIP_PHASE_COUNT - 1);
+
+    const i16 *taps = blip_kernel().taps[phase];
+    i32 *out = blip->samples + index;
+
+    for (u32 k = 0; k < BLIP_KERNEL_WIDTH; ++k)
+    {
+        out[k] += taps[k] * delta;
+    }
+}
+
+// Ends the block at the given clock and returns the number of whole samples that are ready
+u32
+blip_end_block(Blip_Buffer *blip, u32 time)
+{
+    u64 position = static_cast<u64>(time) * blip->factor + blip->offset;
+    blip->offset = position & 0xFFFFFFFF;
+    return static_cast<u32>(position >> 32);
+}
+
+// Integrates count samples into every second element of out and keeps the kernel tail for the next block
+void
+blip_read_samples(Blip_Buffer *blip, i16 *out, u32 count)
+{
+    i32 sum = blip->integrator;
+
+    for (u32 i = 0; i < count; ++i)
+    {
+        sum += blip->samples[i];
+        i32 sample = sum >> BLIP_DELTA_BITS;
+
+        if (sample > 32767)
+        {
+            sample = 32767;
+        }
+        else if (sample < -32768)
+        {
+            sample = -32768;
+        }
+
+        out[i * 2] = static_cast<i16>(sample);
+        sum -= sample << (BLIP_DELTA_BITS - BLIP_BASS_SHIFT);
+    }
+
+    blip->integrator = sum;
+
+    memmove(blip->samples, blip->samples + count, BLIP_KERNEL_WIDTH * sizeof(i32));
+    memset(blip->samples + BLIP_KERNEL_WIDTH, 0, count * sizeof(i32));
+}
+
+u8 &
+apu_register(APU *apu, u16 address)
+{
+    return apu->registers[address - APU_REGISTER_START];
+}
+
+u32
+channel_period(APU *apu, u8 index)
+{
+    APU::Channel *channel = &apu->channels[index];
+
+    switch (index)
+    {
+        case PULSE_1:
+        case PULSE_2:
+            return (2048 - channel->frequency) * 4;
+        case WAVE:
+            return (2048 - channel->frequency) * 2;
+        default:
+        {
+            u8 nr43 = apu_register(apu, NR43);
+            return NOISE_DIVISORS[nr43 & 0x07] << (nr43 >> 4);
+        }
+    }
+}
+
+u8
+channel_output(APU *apu, u8 index)
+{
+    APU::Channel *channel = &apu->channels[index];
+
+    switch (index)
+    {
+        case PULSE_1:
+        case PULSE_2:
+        {
+            u8 duty = apu_register(apu, index == PULSE_1 ? NR11 : NR21) >> 6;
+            return DUTY_WAVEFORMS[duty][channel->position] ? channel->volume : 0;
+        }
+        case WAVE:
+        {
+            u8 sample = apu_register(apu, WAVE_RAM_START + channel->position / 2);
+            sample = (channel->position & 0x01) ? sample & 0x0F : sample >> 4;
+
+            switch ((apu_register(apu, NR32) >> 5) & 0x03)
+            {
+                case 0: return 0;
+                case 1: return sample;
+                case 2: return sample >> 1;
+                default: return sample >> 2;
+            }
+        }
+        default:
+            return (~channel->lfsr & 0x01) ? channel->volume : 0;
+    }
+}
+
+// Pushes the difference between the channel's new level and what the blip buffers currently hold
+void
+update_output(APU *apu, u8 index, u32 time)
+{
+    if (!apu->synthesize)
+    {
+        return;
+    }
+
+    APU::Channel *channel = &apu->channels[index];
+    channel->output = channel_output(apu, index);
+
+    u8 panning = apu_register(apu, NR51);
+    u8 master_volume = apu_register(apu, NR50);
+    i32 level = (channel->enabled && channel->dac_enabled) ? channel->output : 0;
+
+    for (u8 side = 0; side < 2; ++side)
+    {
+        bool routed = side == 0 ? (panning >> (4 + index)) & 0x01 : (panning >> index) & 0x01;
+        i32 volume = (side == 0 ? (master_volume >> 4) & 0x07 : master_volume & 0x07) + 1;
+        i32 amplitude = routed ? level * volume * AMPLITUDE_SCALE : 0;
+        i32 delta = amplitude - channel->amplitude[side];
+
+        if (delta != 0)
+        {
+            blip_add_delta(&apu->blip[side], time, delta);
+            channel->amplitude[side] = amplitude;
+        }
+    }
+}
+
+void
+step_waveform(APU *apu, u8 index, u32 steps)
+{
+    APU::Channel *channel = &apu->channels[index];
+
+    switch (index)
+    {
+        case PULSE_1:
+        case PULSE_2:
+            channel->position = (channel->position + steps) & 0x07;
+            break;
+        case WAVE:
+            channel->position = (channel->position + steps) & 0x1F;
+            break;
+        default:
+            // The LFSR is not observable by the CPU so it is only clocked when producing samples
+            if (apu->synthesize)
+            {
+                bool narrow = apu_register(apu, NR43) & 0x08;
+
+                for (u32 i = 0; i < steps; ++i)
+                {
+                    u16 bit = (channel->lfsr ^ (channel->lfsr >> 1)) & 0x01;
+                    channel->lfsr = (channel->lfsr >> 1) | (bit << 14);
+
+                    if (narrow)
+                    {
+                        channel->lfsr = (channel->lfsr & ~0x40) | (bit << 6);
+                    }
+                }
+            }
+            break;
+    }
+}
+
+// Advances a channel's waveform from apu->time to end emitting a delta at every level change
+void
+run_channel(APU *apu, u8 index, u32 end)
+{
+    APU::Channel *channel = &apu->channels[index];
+
+    if (!channel->enabled)
+    {
+        return;
+    }
+
+    u32 remaining = end - apu->time;
+
+    if (channel->timer > remaining)
+    {
+        channel->timer -= remaining;
+        return;
+    }
+
+    u32 period = channel_period(apu, index);
+
+    if (!apu->synthesize)
+    {
+        remaining -= channel->timer;
+        step_waveform(apu, index, 1 + remaining / period);
+        channel->timer = period - remaining % period;
+        return;
+    }
+
+    u32 time = apu->time;
+
+    while (channel->timer <= remaining)
+    {
+        time += channel->timer;
+        remaining -= channel->timer;
+        channel->timer = period;
+
+        step_waveform(apu, index, 1);
+        update_output(apu, index, time);
+    }
+
+    channel->timer -= remaining;
+}
+
+u16
+sweep_calculate(APU *apu)
+{
+    u8 nr10 = apu_register(apu, NR10);
+    u16 delta = apu->sweep_shadow >> (nr10 & 0x07);
+    u16 frequency = (nr10 & 0x08) ? apu->sweep_shadow - delta : apu->sweep_shadow + delta;
+
+    if (frequency > 2047)
+    {
+        apu->channels[PULSE_1].enabled = false;
+    }
+
+    return frequency;
+}
+
+void
+clock_length(APU *apu)
+{
+    for (u8 i = 0; i < 4; ++i)
+    {
+        APU::Channel *channel = &apu->channels[i];
+
+        if (channel->length_enabled && channel->length_counter > 0)
+        {
+            if (--channel->length_counter == 0)
+            {
+                channel->enabled = false;
+                update_output(apu, i, apu->time);
+            }
+        }
+    }
+}
+
+void
+clock_sweep(APU *apu)
+{
+    u8 nr10 = apu_register(apu, NR10);
+    u8 period = (nr10 >> 4) & 0x07;
+
+    if (--apu->sweep_timer > 0)
+    {
+        return;
+    }
+
+    apu->sweep_timer = period ? period : 8;
+
+    if (!apu->sweep_enabled || period == 0)
+    {
+        return;
+    }
+
+    u16 frequency = sweep_calculate(apu);
+
+    if (frequency <= 2047 && (nr10 & 0x07))
+    {
+        apu->sweep_shadow = frequency;
+        apu->channels[PULSE_1].frequency = frequency;
+        sweep_calculate(apu);
+    }
+
+    update_output(apu, PULSE_1, apu->time);
+}
+
+void
+clock_envelope(APU *apu)
+{
+    for (u8 i = 0; i < 4; ++i)
+    {
+        APU::Channel *channel = &apu->channels[i];
+
+        if (i == WAVE || channel->envelope_period == 0)
+        {
+            continue;
+        }
+
+        if (--channel->envelope_timer > 0)
+        {
+            continue;
+        }
+
+        channel->envelope_timer = channel->envelope_period;
+
+        if (channel->envelope_increase && channel->volume < 15)
+        {
+            channel->volume++;
+            update_output(apu, i, apu->time);
+        }
+        else if (!channel->envelope_increase && channel->volume > 0)
+        {
+            channel->volume--;
+            update_output(apu, i, apu->time);
+        }
+    }
+}
+
+void
+clock_frame_sequencer(APU *apu)
+{
+    if ((apu->sequencer_step & 0x01) == 0)
+    {
+        clock_length(apu);
+    }
+
+    if (apu->sequencer_step == 2 || apu->sequencer_step == 6)
+    {
+        clock_sweep(apu);
+    }
+
+    if (apu->sequencer_step == 7)
+    {
+        clock_envelope(apu);
+    }
+
+    apu->sequencer_step = (apu->sequencer_step + 1) & 0x07;
+}
+
+// Emulates every channel up to end, splitting the span at frame sequencer ticks
+void
+run_until(APU *apu, u32 end)
+{
+    while (apu->time < end)
+    {
+        u32 segment_end = end;
+
+        if (apu->time + apu->sequencer_timer < segment_end)
+        {
+            segment_end = apu->time + apu->sequencer_timer;
+        }
+
+        for (u8 i = 0; i < 4; ++i)
+        {
+            run_channel(apu, i, segment_end);
+        }
+
+        apu->sequencer_timer -= segment_end - apu->time;
+        apu->time = segment_end;
+
+        if (apu->sequencer_timer == 0)
+        {
+            apu->sequencer_timer = FRAME_SEQUENCER_CYCLES;
+            clock_frame_sequencer(apu);
+        }
+    }
+}
+
+void
+flush_block(APU *apu)
+{
+    if (apu->synthesize)
+    {
+        u32 count = blip_end_block(&apu->blip[0], apu->time);
+        blip_end_block(&apu->blip[1], apu->time);
+
+        i16 samples[BLIP_BUFFER_SIZE * 2];
+        blip_read_samples(&apu->blip[0], samples, count);
+        blip_read_samples(&apu->blip[1], samples + 1, count);
+
+        // The emulator never waits on the sink, samples are dropped when it falls behind
+        audio_ring_write(&apu->ring, samples, count * 2);
+    }
+
+    apu->block_start += apu->time;
+    apu->time = 0;
+}
+
+// Brings the APU up to the given bus cycle, flushing full blocks as it goes
+void
+sync(APU *apu, u64 now)
+{
+    while (now - apu->block_start > APU_MAX_BLOCK_CYCLES)
+    {
+        run_until(apu, APU_MAX_BLOCK_CYCLES);
+        flush_block(apu);
+    }
+
+    run_until(apu, static_cast<u32>(now - apu->block_start));
+}
+
+void
+trigger(APU *apu, u8 index)
+{
+    APU::Channel *channel = &apu->channels[index];
+
+    channel->enabled = channel->dac_enabled;
+
+    if (channel->length_counter == 0)
+    {
+        channel->length_counter = index == WAVE ? 256 : 64;
+    }
+
+    channel->timer = channel_period(apu, index);
+
+    switch (index)
+    {
+        case PULSE_1:
+        case PULSE_2:
+        case NOISE:
+        {
+            u8 envelope = apu_register(apu, index == PULSE_1 ? NR12 : index == PULSE_2 ? NR22 : NR42);
+            channel->volume = envelope >> 4;
+            channel->envelope_increase = envelope & 0x08;
+            channel->envelope_period = envelope & 0x07;
+            channel->envelope_timer = channel->envelope_period;
+            channel->lfsr = 0x7FFF;
+        } break;
+        case WAVE:
+            channel->position = 0;
+            break;
+    }
+
+    if (index == PULSE_1)
+    {
+        u8 nr10 = apu_register(apu, NR10);
+        u8 period = (nr10 >> 4) & 0x07;
+
+        apu->sweep_shadow = channel->frequency;
+        apu->sweep_timer = period ? period : 8;
+        apu->sweep_enabled = period || (nr10 & 0x07);
+
+        if (nr10 & 0x07)
+        {
+            sweep_calculate(apu);
+        }
+    }
+}
+
+void
+write_frequency_low(APU *apu, u8 index, u8 v)
+{
+    APU::Channel *channel = &apu->channels[index];
+    channel->frequency = (channel->frequency & 0x0700) | v;
+}
+
+void
+write_frequency_high(APU *apu, u8 index, u8 v)
+{
+    APU::Channel *channel = &apu->channels[index];
+    channel->frequency = (channel->frequency & 0x00FF) | (static_cast<u16>(v & 0x07) << 8);
+    channel->length_enabled = v & 0x40;
+
+    if (v & 0x80)
+    {
+        trigger(apu, index);
+    }
+}
+
+void
+write_envelope_register(APU *apu, u8 index, u8 v)
+{
+    APU::Channel *channel = &apu->channels[index];
+    channel->dac_enabled = (v & 0xF8) != 0;
+
+    if (!channel->dac_enabled)
+    {
+        channel->enabled = false;
+    }
+}
+
+void
+power_off(APU *apu)
+{
+    for (u16 address = NR10; address < NR52; ++address)
+    {
+        apu_register(apu, address) = 0;
+    }
+
+    for (u8 i = 0; i < 4; ++i)
+    {
+        APU::Channel *channel = &apu->channels[i];
+        channel->enabled = false;
+        channel->dac_enabled = false;
+        channel->length_enabled = false;
+        channel->frequency = 0;
+        channel->volume = 0;
+        channel->envelope_period = 0;
+    }
+}
+
+void
+apu_write(APU *apu, u16 address, u8 v, u64 now)
+{
+    sync(apu, now);
+
+    bool powered = apu_register(apu, NR52) & 0x80;
+
+    if (address >= WAVE_RAM_START)
+    {
+        apu_register(apu, address) = v;
+        update_output(apu, WAVE, apu->time);
+        return;
+    }
+
+    if (address == NR52)
+    {
+        if (powered && !(v & 0x80))
+        {
+            power_off(apu);
+        }
+        else if (!powered && (v & 0x80))
+        {
+            apu->sequencer_step = 0;
+        }
+
+        apu_register(apu, NR52) = v & 0x80;
+
+        for (u8 i = 0; i < 4; ++i)
+        {
+            update_output(apu, i, apu->time);
+        }
+
+        return;
+    }
+
+    if (!powered)
+    {
+        return;
+    }
+
+    apu_register(apu, address) = v;
+
+    switch (address)
+    {
+        case NR11:
+            apu->channels[PULSE_1].length_counter = 64 - (v & 0x3F);
+            break;
+        case NR21:
+            apu->channels[PULSE_2].length_counter = 64 - (v & 0x3F);
+            break;
+        case NR31:
+            apu->channels[WAVE].length_counter = 256 - v;
+            break;
+        case NR41:
+            apu->channels[NOISE].length_counter = 64 - (v & 0x3F);
+            break;
+        case NR12:
+            write_envelope_register(apu, PULSE_1, v);
+            break;
+        case NR22:
+            write_envelope_register(apu, PULSE_2, v);
+            break;
+        case NR42:
+            write_envelope_register(apu, NOISE, v);
+            break;
+        case NR30:
+            apu->channels[WAVE].dac_enabled = v & 0x80;
+
+            if (!apu->channels[WAVE].dac_enabled)
+            {
+                apu->channels[WAVE].enabled = false;
+            }
+            break;
+        case NR13:
+            write_frequency_low(apu, PULSE_1, v);
+            break;
+        case NR14:
+            write_frequency_high(apu, PULSE_1, v);
+            break;
+        case NR23:
+            write_frequency_low(apu, PULSE_2, v);
+            break;
+        case NR24:
+            write_frequency_high(apu, PULSE_2, v);
+            break;
+        case NR33:
+            write_frequency_low(apu, WAVE, v);
+            break;
+        case NR34:
+            write_frequency_high(apu, WAVE, v);
+            break;
+        case NR44:
+            apu->channels[NOISE].length_enabled = v & 0x40;
+
+            if (v & 0x80)
+            {
+                trigger(apu, NOISE);
+            }
+            break;
+    }
+
+    // Any register can change the level of a channel (volume, panning, duty...) so refresh them all
+    for (u8 i = 0; i < 4; ++i)
+    {
+        update_output(apu, i, apu->time);
+    }
+}
+
+u8
+apu_read(APU *apu, u16 address, u64 now)
+{
+    if (address >= WAVE_RAM_START)
+    {
+        return apu_register(apu, address);
+    }
+
+    if (address == NR52)
+    {
+        // Channel status bits depend on length counters so the APU has to be brought up to date
+        sync(apu, now);
+
+        u8 status = apu_register(apu, NR52) | REGISTER_READ_MASK[address - APU_REGISTER_START];
+
+        for (u8 i = 0; i < 4; ++i)
+        {
+            if (apu->channels[i].enabled)
+            {
+                status |= 0x01 << i;
+            }
+        }
+
+        return status;
+    }
+
+    return apu_register(apu, address) | REGISTER_READ_MASK[address - APU_REGISTER_START];
+}
+
+void
+apu_end_block(APU *apu, u64 now)
+{
+    sync(apu, now);
+    flush_block(apu);
+}
+
+void
+apu_set_synthesize(APU *apu, bool synthesize, u64 now)
+{
+    sync(apu, now);
+    flush_block(apu);
+
+    apu->synthesize = synthesize;
+
+    if (synthesize)
+    {
+        blip_init(&apu->blip[0]);
+        blip_init(&apu->blip[1]);
+
+        for (u8 i = 0; i < 4; ++i)
+        {
+            apu->channels[i].amplitude[0] = 0;
+            apu->channels[i].amplitude[1] = 0;
+            update_output(apu, i, 0);
+        }
+    }
+}
+
+void
+apu_init(APU *apu, bool synthesize)
+{
+    printf("[APU] reset state\n");
+
+    memset(apu->channels, 0, sizeof(apu->channels));
+    memset(apu->registers, 0, sizeof(apu->registers));
+
+    apu->sweep_shadow = 0;
+    apu->sweep_timer = 8;
+    apu->sweep_enabled = false;
+
+    apu->sequencer_step = 0;
+    apu->sequencer_timer = FRAME_SEQUENCER_CYCLES;
+
+    apu->block_start = 0;
+    apu->time = 0;
+    apu->synthesize = synthesize;
+
+    blip_init(&apu->blip[0]);
+    blip_init(&apu->blip[1]);
+    audio_ring_init(&apu->ring);
+
+    // Post boot ROM state
+    apu_register(apu, NR52) = 0x80;
+    apu_register(apu, NR50) = 0x77;
+    apu_register(apu, NR51) = 0xF3;
+}
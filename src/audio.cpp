@@ -0,0 +1,166 @@
+#include "emulator.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+constexpr u32 AUDIO_CHANNELS = 2;
+constexpr u32 WAV_HEADER_SIZE = 44;
+constexpr u32 SINK_CHUNK_SAMPLES = 4096;
+
+void
+audio_ring_init(Audio_Ring_Buffer *ring)
+{
+    ring->read.store(0, std::memory_order_relaxed);
+    ring->write.store(0, std::memory_order_relaxed);
+}
+
+// Producer side, returns how many samples fit. Never blocks
+u32
+audio_ring_write(Audio_Ring_Buffer *ring, i16 *samples, u32 count)
+{
+    u32 write = ring->write.load(std::memory_order_relaxed);
+    u32 read = ring->read.load(std::memory_order_acquire);
+    u32 space = AUDIO_RING_BUFFER_SIZE - (write - read);
+
+    if (count > space)
+    {
+        count = space;
+    }
+
+    for (u32 i = 0; i < count; ++i)
+    {
+        ring->samples[(write + i) & (AUDIO_RING_BUFFER_SIZE - 1)] = samples[i];
+    }
+
+    ring->write.store(write + count, std::memory_order_release);
+    return count;
+}
+
+// Consumer side, returns how many samples were available
+u32
+audio_ring_read(Audio_Ring_Buffer *ring, i16 *samples, u32 count)
+{
+    u32 read = ring->read.load(std::memory_order_relaxed);
+    u32 write = ring->write.load(std::memory_order_acquire);
+    u32 available = write - read;
+
+    if (count > available)
+    {
+        count = available;
+    }
+
+    for (u32 i = 0; i < count; ++i)
+    {
+        samples[i] = ring->samples[(read + i) & (AUDIO_RING_BUFFER_SIZE - 1)];
+    }
+
+    ring->read.store(read + count, std::memory_order_release);
+    return count;
+}
+
+void
+write_u32_le(u8 *out, u32 v)
+{
+    out[0] = v & 0xFF;
+    out[1] = (v >> 8) & 0xFF;
+    out[2] = (v >> 16) & 0xFF;
+    out[3] = (v >> 24) & 0xFF;
+}
+
+void
+write_wav_header(FILE *file, u32 data_size)
+{
+    u8 header[WAV_HEADER_SIZE] = {
+        'R', 'I', 'F', 'F', 0, 0, 0, 0, 'W', 'A', 'V', 'E',
+        'f', 'm', 't', ' ', 16, 0, 0, 0,
+        1, 0, // PCM
+        AUDIO_CHANNELS, 0,
+        0, 0, 0, 0, // sample rate
+        0, 0, 0, 0, // byte rate
+        AUDIO_CHANNELS * sizeof(i16), 0,
+        16, 0,
+        'd', 'a', 't', 'a', 0, 0, 0, 0
+    };
+
+    write_u32_le(header + 4, WAV_HEADER_SIZE - 8 + data_size);
+    write_u32_le(header + 24, AUDIO_SAMPLE_RATE);
+    write_u32_le(header + 28, AUDIO_SAMPLE_RATE * AUDIO_CHANNELS * sizeof(i16));
+    write_u32_le(header + 40, data_size);
+
+    fseek(file, 0, SEEK_SET);
+    fwrite(header, 1, sizeof(header), file);
+}
+
+u32
+drain_to_file(Audio_Sink *sink, Audio_Ring_Buffer *ring)
+{
+    i16 samples[SINK_CHUNK_SAMPLES];
+    u32 count = audio_ring_read(ring, samples, SINK_CHUNK_SAMPLES);
+
+    if (count > 0)
+    {
+        // WAV is little endian as are all the platforms we build for
+        fwrite(samples, sizeof(i16), count, sink->file);
+        sink->data_size += count * sizeof(i16);
+    }
+
+    return count;
+}
+
+void
+wav_sink_thread(Audio_Sink *sink, Audio_Ring_Buffer *ring)
+{
+    while (sink->running.load(std::memory_order_acquire))
+    {
+        if (drain_to_file(sink, ring) == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    }
+}
+
+bool
+audio_sink_open_wav(Audio_Sink *sink, Audio_Ring_Buffer *ring, char *path)
+{
+    sink->file = fopen(path, "wb");
+
+    if (!sink->file)
+    {
+        printf("[Audio] Unable to open %s\n", path);
+        sink->type = Audio_Sink::Type::NONE;
+        return false;
+    }
+
+    printf("[Audio] Writing samples to: %s\n", path);
+
+    sink->type = Audio_Sink::Type::WAV;
+    sink->data_size = 0;
+    write_wav_header(sink->file, 0);
+
+    sink->running.store(true, std::memory_order_release);
+    sink->thread = std::thread(wav_sink_thread, sink, ring);
+
+    return true;
+}
+
+void
+audio_sink_close(Audio_Sink *sink, Audio_Ring_Buffer *ring)
+{
+    if (sink->type != Audio_Sink::Type::WAV)
+    {
+        return;
+    }
+
+    sink->running.store(false, std::memory_order_release);
+    sink->thread.join();
+
+    while (drain_to_file(sink, ring) > 0)
+    {
+    }
+
+    write_wav_header(sink->file, sink->data_size);
+    fclose(sink->file);
+
+    sink->type = Audio_Sink::Type::NONE;
+}
@@ -0,0 +1,151 @@
+#include "emulator.h"
+
+#include <cstdio>
+#include <cstring>
+
+void
+run_claimed_instances(Batch *batch)
+{
+    for (u32 i = batch->next.fetch_add(1, std::memory_order_acq_rel); i < batch->count; i = batch->next.fetch_add(1, std::memory_order_acq_rel))
+    {
+        GameBoy *gb = &batch->gameboys[i];
+
+        joypad_set_buttons(&gb->memory_bus, batch->buttons[i]);
+        gameboy_run_frame(gb);
+        apu_end_block(&gb->apu, gb->memory_bus.cycles);
+
+        if (batch->completed.fetch_add(1, std::memory_order_acq_rel) + 1 == batch->count)
+        {
+            std::lock_guard<std::mutex> lock(batch->mutex);
+            batch->done.notify_one();
+        }
+    }
+}
+
+void
+batch_worker(Batch *batch)
+{
+    u64 seen = 0;
+
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(batch->mutex);
+            batch->start.wait(lock, [batch, seen]() { return !batch->running || batch->generation != seen; });
+
+            if (!batch->running)
+            {
+                return;
+            }
+
+            seen = batch->generation;
+        }
+
+        run_claimed_instances(batch);
+    }
+}
+
+// All instances share the ROM data, which is never written. threads counts the calling thread,
+// 0 uses every hardware thread. Each PPU writes its observations straight into the batch buffer
+Batch *
+batch_create(u8 *rom, u64 size, u32 count, u32 threads, u8 downscale, u8 stack)
+{
+    if (count == 0 || stack == 0 || downscale == 0 || GAMEBOY_WIDTH % downscale || GAMEBOY_HEIGHT % downscale)
+    {
+        printf("[Batch] Invalid batch of %u instances downscaled by %u stacking %u frames\n", count, downscale, stack);
+        return NULL;
+    }
+
+    Batch *batch = new Batch();
+    batch->gameboys = new GameBoy[count]();
+    batch->count = count;
+
+    batch->downscale = downscale;
+    batch->stack = stack;
+    batch->observation_width = GAMEBOY_WIDTH / downscale;
+    batch->observation_height = GAMEBOY_HEIGHT / downscale;
+
+    u32 observation_size = stack * batch->observation_width * batch->observation_height;
+    batch->observations = new u8[count * observation_size]();
+
+    for (u32 i = 0; i < count; ++i)
+    {
+        GameBoy *gb = &batch->gameboys[i];
+
+        if (!cartridge_load(&gb->memory_bus.cartridge, rom, size))
+        {
+            delete[] batch->observations;
+            delete[] batch->gameboys;
+            delete batch;
+            return NULL;
+        }
+
+        gameboy_init(gb);
+        ppu_set_observation(&gb->ppu, batch->observations + i * observation_size, downscale, stack);
+    }
+
+    batch->buttons = new u8[count]();
+
+    batch->generation = 0;
+    batch->running = true;
+    batch->next.store(count, std::memory_order_relaxed);
+    batch->completed.store(0, std::memory_order_relaxed);
+
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+
+    for (u32 i = 1; i < threads && i < count; ++i)
+    {
+        batch->workers.emplace_back(batch_worker, batch);
+    }
+
+    printf("[Batch] %u instances on %u threads, %ux%u observations stacking %u frames\n", count, static_cast<u32>(batch->workers.size()) + 1,
+        batch->observation_width, batch->observation_height, stack);
+
+    return batch;
+}
+
+void
+batch_destroy(Batch *batch)
+{
+    {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        batch->running = false;
+    }
+
+    batch->start.notify_all();
+
+    for (std::thread &worker : batch->workers)
+    {
+        worker.join();
+    }
+
+    delete[] batch->buttons;
+    delete[] batch->observations;
+    delete[] batch->gameboys;
+    delete batch;
+}
+
+// Advances every instance by one frame with buttons[i] held on instance i, the calling thread
+// works alongside the pool and returns once every observation is written
+void
+batch_step(Batch *batch, u8 *buttons)
+{
+    memcpy(batch->buttons, buttons, batch->count);
+    batch->completed.store(0, std::memory_order_relaxed);
+    batch->next.store(0, std::memory_order_release);
+
+    {
+        std::lock_guard<std::mutex> lock(batch->mutex);
+        batch->generation++;
+    }
+
+    batch->start.notify_all();
+
+    run_claimed_instances(batch);
+
+    std::unique_lock<std::mutex> lock(batch->mutex);
+    batch->done.wait(lock, [batch]() { return batch->completed.load(std::memory_order_acquire) == batch->count; });
+}
@@ -1,4 +1,5 @@
 #include "emulator.h"
+#include <bit>
 #include <cstdio>
 
 constexpr i8 ZERO_FLAG_POS = 7;
@@ -435,6 +436,15 @@ stack_pop(CPU *cpu, Memory_Bus *memory_bus)
     });
 }
 
+// Short backward jumps are where polling loops start over, see Idle_Loop
+void
+jump_relative(CPU *cpu)
+{
+    i8 offset = static_cast<i8>(cpu->w);
+    cpu->pc += offset;
+    cpu->jumped_back = offset < 0 && offset >= -static_cast<i8>(IDLE_LOOP_BYTES);
+}
+
 void
 set_pc_from_tmp_2m(CPU *cpu)
 {
@@ -494,6 +504,8 @@ set_pc_from_mem_pc(CPU *cpu, Memory_Bus *memory_bus)
 void 
 handle_extended_opcode(CPU *cpu, Memory_Bus *memory_bus, u8 opcode)
 {
+    profile_opcode(memory_bus->profiler, opcode, true);
+
     u8 src = opcode & 0x07;
     u8 second_val = (opcode >> 3) & 0x07;
 
@@ -1089,6 +1101,8 @@ handle_extended_opcode(CPU *cpu, Memory_Bus *memory_bus, u8 opcode)
 void
 handle_opcode(CPU *cpu, Memory_Bus *memory_bus, u8 opcode)
 {
+    profile_opcode(memory_bus->profiler, opcode, false);
+
     switch(opcode)
     {
         case 0x00: // NOP
@@ -1240,7 +1254,7 @@ handle_opcode(CPU *cpu, Memory_Bus *memory_bus, u8 opcode)
 
             cpu->pipeline.push_back([](CPU *cpu, Memory_Bus *memory_bus)
             {
-                cpu->pc += static_cast<i8>(cpu->w);
+                jump_relative(cpu);
             });
             
             cpu->state = CPU::STATE::EXECUTE_PIPELINE;
@@ -1290,7 +1304,7 @@ handle_opcode(CPU *cpu, Memory_Bus *memory_bus, u8 opcode)
 
                 cpu->pipeline.push_back([](CPU *cpu, Memory_Bus *memory_bus)
                 {
-                    cpu->pc += static_cast<i8>(cpu->w);
+                    jump_relative(cpu);
                 });
             }
 
@@ -1370,7 +1384,7 @@ handle_opcode(CPU *cpu, Memory_Bus *memory_bus, u8 opcode)
 
                 cpu->pipeline.push_back([](CPU *cpu, Memory_Bus *memory_bus)
                 {
-                    cpu->pc += static_cast<i8>(cpu->w);
+                    jump_relative(cpu);
                 });
             }
             else
@@ -1439,7 +1453,7 @@ handle_opcode(CPU *cpu, Memory_Bus *memory_bus, u8 opcode)
 
                 cpu->pipeline.push_back([](CPU *cpu, Memory_Bus *memory_bus)
                 {
-                    cpu->pc += static_cast<i8>(cpu->w);
+                    jump_relative(cpu);
                 });
             }
 
@@ -1490,7 +1504,7 @@ handle_opcode(CPU *cpu, Memory_Bus *memory_bus, u8 opcode)
 
                 cpu->pipeline.push_back([](CPU *cpu, Memory_Bus *memory_bus)
                 {
-                    cpu->pc += static_cast<i8>(cpu->w);
+                    jump_relative(cpu);
                 });
             }
             else
@@ -2423,6 +2437,36 @@ insert_pipeline(CPU *cpu, Memory_Bus *memory_bus, u8 opcode)
     }
 }
 
+// Vectors by IF bit. The serial port is not emulated, its interrupt keeps pc and only shows up in the trace
+constexpr u16 INTERRUPT_VECTORS[5] = {0x40, 0x48, 0x50, 0x58, 0x60};
+
+// Two idle cycles, pc pushed high byte first, then the jump to the vector
+void
+dispatch_interrupt(CPU *cpu, Memory_Bus *memory_bus)
+{
+    switch (cpu->dispatch_cycle++)
+    {
+        case 2:
+            memory_bus->write_u8(--cpu->sp, (cpu->pc >> 8) & 0xFF);
+            break;
+        case 3:
+            memory_bus->write_u8(--cpu->sp, cpu->pc & 0xFF);
+            break;
+        case 4:
+            if (cpu->w == INTERRUPT_SERIAL)
+            {
+                trace_event(memory_bus->trace, Trace_Level::INFO, Trace_Event::SERIAL_INTERRUPT, memory_bus->cycles);
+            }
+            else
+            {
+                cpu->pc = INTERRUPT_VECTORS[std::countr_zero(cpu->w)];
+            }
+
+            cpu->state = CPU::STATE::READ_OPCODE;
+            break;
+    }
+}
+
 void
 cpu_tick(CPU *cpu, Memory_Bus *memory_bus)
 {
@@ -2441,6 +2485,11 @@ cpu_tick(CPU *cpu, Memory_Bus *memory_bus)
     switch (cpu->state)
     {
         case CPU::STATE::READ_OPCODE:
+            if (!cpu->extended)
+            {
+                profile_instruction_start(memory_bus->profiler, memory_bus->cartridge.current_rom_bank, cpu->pc);
+            }
+
             insert_pipeline(cpu, memory_bus, memory_bus->read_u8(cpu->pc++));
             break;
         case CPU::STATE::EXECUTE_PIPELINE:
@@ -2452,11 +2501,50 @@ cpu_tick(CPU *cpu, Memory_Bus *memory_bus)
                 cpu->state = CPU::STATE::READ_OPCODE;
             }
             break;
+        case CPU::STATE::DISPATCH_INTERRUPT:
+            dispatch_interrupt(cpu, memory_bus);
+            break;
+    }
+}
+
+// The lowest pending bit has the highest priority
+void
+handle_interrupt(CPU *cpu, Memory_Bus *memory_bus)
+{
+    u8 bit = 0x01 << std::countr_zero(memory_bus->interrupts_pending);
+
+    cpu->halted = false;
+    cpu->interrupt_master_enable = false;
+
+    memory_bus->write_u8(INTERRUPT_FLAG, memory_bus->memory[INTERRUPT_FLAG] & ~bit);
+
+    cpu->w = bit;
+    cpu->dispatch_cycle = 0;
+    cpu->state = CPU::STATE::DISPATCH_INTERRUPT;
+}
+
+void 
+cpu_cycle(CPU *cpu, Memory_Bus *memory_bus)
+{
+    profile_cpu_cycle(memory_bus->profiler);
+    cpu_tick(cpu, memory_bus);
+
+    // TODO: check only service interrupts after an opcode has been completed is correct
+    if (cpu->state != CPU::STATE::READ_OPCODE)
+    {
+        return;
+    }
+
+    if (cpu->interrupt_master_enable && memory_bus->interrupts_pending)
+    {
+        handle_interrupt(cpu, memory_bus);
     }
 }
 
+// The lockstep reference dispatches the way the core first did: IF and IE are read through the bus
+// every cycle and the five dispatch cycles are queued as micro-ops
 void
-handle_interrupt(CPU *cpu, Memory_Bus *memory_bus, u8 interrupt_flag)
+handle_interrupt_reference(CPU *cpu, Memory_Bus *memory_bus, u8 interrupt_flag)
 {
     u8 interrupt_enable = memory_bus->read_u8(INTERRUPT_ENABLE); // IE flag
 
@@ -2500,7 +2588,7 @@ handle_interrupt(CPU *cpu, Memory_Bus *memory_bus, u8 interrupt_flag)
                     cpu->pc = 0x50;
                     break;
                 case INTERRUPT_SERIAL:
-                    printf("[CPU] Serial interrupt triggered\n");
+                    trace_event(memory_bus->trace, Trace_Level::INFO, Trace_Event::SERIAL_INTERRUPT, memory_bus->cycles);
                     break;
                 case INTERRUPT_JOYPAD:
                     cpu->pc = 0x60;
@@ -2515,11 +2603,10 @@ handle_interrupt(CPU *cpu, Memory_Bus *memory_bus, u8 interrupt_flag)
 }
 
 void 
-cpu_cycle(CPU *cpu, Memory_Bus *memory_bus)
+cpu_cycle_reference(CPU *cpu, Memory_Bus *memory_bus)
 {
     cpu_tick(cpu, memory_bus);
 
-    // TODO: check only service interrupts after an opcode has been completed is correct
     if (cpu->state == CPU::STATE::EXECUTE_PIPELINE)
     {
         return;
@@ -2529,8 +2616,91 @@ cpu_cycle(CPU *cpu, Memory_Bus *memory_bus)
 
     if (cpu->interrupt_master_enable && interrupt_flag)
     {
-        handle_interrupt(cpu, memory_bus, interrupt_flag);
+        handle_interrupt_reference(cpu, memory_bus, interrupt_flag);
+    }
+}
+
+// Whether the instruction at pc may be part of a polling loop: it can branch and change registers and
+// flags but never writes memory, the stack or IME. reads is set when it reads memory other than its
+// own operands, with the address it reads
+bool
+cpu_polling_instruction(CPU *cpu, Memory_Bus *memory_bus, u16 *address, bool *reads)
+{
+    u8 opcode = memory_bus->read_u8(cpu->pc);
+    *reads = false;
+
+    if (opcode == 0xCB)
+    {
+        u8 extended = memory_bus->read_u8(cpu->pc + 1);
+
+        // BIT only, every other extended opcode writes its operand back
+        if (extended < 0x40 || extended >= 0x80)
+        {
+            return false;
+        }
+
+        if ((extended & 0x07) == 6)
+        {
+            *address = register_hl(cpu);
+            *reads = true;
+        }
+
+        return true;
+    }
+
+    // LD r,r' and the ALU on A, with (HL) as a source but not as a destination
+    if (opcode >= 0x40 && opcode < 0xC0)
+    {
+        if (opcode >= 0x70 && opcode < 0x78)
+        {
+            return false;
+        }
+
+        if ((opcode & 0x07) == 6)
+        {
+            *address = register_hl(cpu);
+            *reads = true;
+        }
+
+        return true;
     }
+
+    switch (opcode)
+    {
+        case 0x0A: // ld a,(bc)
+            *address = register_bc(cpu);
+            *reads = true;
+            return true;
+        case 0x1A: // ld a,(de)
+            *address = register_de(cpu);
+            *reads = true;
+            return true;
+        case 0xF0: // ldh a,(n)
+            *address = 0xFF00 + memory_bus->read_u8(cpu->pc + 1);
+            *reads = true;
+            return true;
+        case 0xF2: // ld a,(c)
+            *address = 0xFF00 + cpu->registers[Register::C];
+            *reads = true;
+            return true;
+        case 0xFA: // ld a,(nn)
+            *address = memory_bus->read_u16(cpu->pc + 1);
+            *reads = true;
+            return true;
+        case 0x00: // nop
+        case 0x04: case 0x05: case 0x0C: case 0x0D: // inc/dec r
+        case 0x14: case 0x15: case 0x1C: case 0x1D:
+        case 0x24: case 0x25: case 0x2C: case 0x2D:
+        case 0x3C: case 0x3D:
+        case 0x06: case 0x0E: case 0x16: case 0x1E: case 0x26: case 0x2E: case 0x3E: // ld r,n
+        case 0x07: case 0x0F: case 0x17: case 0x1F: case 0x27: case 0x2F: case 0x37: case 0x3F: // A and flags
+        case 0xC6: case 0xCE: case 0xD6: case 0xDE: case 0xE6: case 0xEE: case 0xF6: case 0xFE: // alu a,n
+        case 0x18: case 0x20: case 0x28: case 0x30: case 0x38: // jr
+        case 0xC3: case 0xC2: case 0xCA: case 0xD2: case 0xDA: // jp
+            return true;
+    }
+
+    return false;
 }
 
 void
@@ -2550,6 +2720,8 @@ cpu_init(CPU *cpu, Memory_Bus *memory_bus, bool cgb, u8 old_licence_code, u8 new
     cpu->tick = 0;
     cpu->pc = 0x100;
     cpu->sp = 0xFFFE;
+    cpu->jumped_back = false;
+    cpu->dispatch_cycle = 0;
 
     if (cgb)
     {
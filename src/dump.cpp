@@ -0,0 +1,317 @@
+#include "emulator.h"
+
+#include <cstdio>
+#include <cstring>
+
+constexpr u32 DEFLATE_STORED_BLOCK = 65535;
+
+const u8 DUMP_SOURCES[] = {DUMP_FRAME, DUMP_TILES, DUMP_BACKGROUND};
+const char *DUMP_SOURCE_NAMES[] = {"frame", "tiles", "background"};
+const char *IMAGE_FORMAT_EXTENSIONS[] = {"png", "ppm"};
+
+u32
+crc32_update(u32 crc, const u8 *data, u32 size)
+{
+    static u32 table[256];
+
+    if (!table[1])
+    {
+        for (u32 i = 0; i < 256; ++i)
+        {
+            u32 c = i;
+
+            for (u32 k = 0; k < 8; ++k)
+            {
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+
+            table[i] = c;
+        }
+    }
+
+    crc = ~crc;
+
+    for (u32 i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+
+    return ~crc;
+}
+
+void
+append_u32_be(std::vector<u8> *out, u32 v)
+{
+    out->push_back((v >> 24) & 0xFF);
+    out->push_back((v >> 16) & 0xFF);
+    out->push_back((v >> 8) & 0xFF);
+    out->push_back(v & 0xFF);
+}
+
+void
+write_png_chunk(FILE *file, const char *type, std::vector<u8> &data)
+{
+    std::vector<u8> chunk;
+    append_u32_be(&chunk, static_cast<u32>(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    append_u32_be(&chunk, crc32_update(0, chunk.data() + 4, static_cast<u32>(chunk.size() - 4)));
+
+    fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+// 2 bit indexed PNG with the shades as its palette. The image data is a zlib stream of stored
+// deflate blocks, shades pack four to a byte so frames stay small without a compressor
+bool
+write_png(FILE *file, u8 *shades, u32 width, u32 height)
+{
+    const u8 signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    fwrite(signature, 1, sizeof(signature), file);
+
+    std::vector<u8> header;
+    append_u32_be(&header, width);
+    append_u32_be(&header, height);
+    header.push_back(2); // bit depth
+    header.push_back(3); // indexed colour
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+    write_png_chunk(file, "IHDR", header);
+
+    std::vector<u8> palette;
+
+    for (u32 colour : SHADE_COLOURS)
+    {
+        palette.push_back((colour >> 16) & 0xFF);
+        palette.push_back((colour >> 8) & 0xFF);
+        palette.push_back(colour & 0xFF);
+    }
+
+    write_png_chunk(file, "PLTE", palette);
+
+    u32 stride = (width + 3) / 4;
+    std::vector<u8> rows((stride + 1) * height, 0);
+
+    for (u32 y = 0; y < height; ++y)
+    {
+        u8 *row = rows.data() + y * (stride + 1) + 1; // filter type 0 precedes each row
+
+        for (u32 x = 0; x < width; ++x)
+        {
+            row[x / 4] |= (shades[y * width + x] & 0x03) << (6 - (x % 4) * 2);
+        }
+    }
+
+    std::vector<u8> zlib = {0x78, 0x01};
+    u32 adler_a = 1;
+    u32 adler_b = 0;
+
+    for (u32 position = 0; position < rows.size(); position += DEFLATE_STORED_BLOCK)
+    {
+        u32 length = static_cast<u32>(rows.size()) - position;
+        length = length > DEFLATE_STORED_BLOCK ? DEFLATE_STORED_BLOCK : length;
+
+        zlib.push_back(position + length == rows.size() ? 1 : 0);
+        zlib.push_back(length & 0xFF);
+        zlib.push_back(length >> 8);
+        zlib.push_back(~length & 0xFF);
+        zlib.push_back((~length >> 8) & 0xFF);
+        zlib.insert(zlib.end(), rows.begin() + position, rows.begin() + position + length);
+
+        for (u32 i = position; i < position + length; ++i)
+        {
+            adler_a = (adler_a + rows[i]) % 65521;
+            adler_b = (adler_b + adler_a) % 65521;
+        }
+    }
+
+    append_u32_be(&zlib, (adler_b << 16) | adler_a);
+    write_png_chunk(file, "IDAT", zlib);
+
+    std::vector<u8> end;
+    write_png_chunk(file, "IEND", end);
+
+    return true;
+}
+
+bool
+write_ppm(FILE *file, u8 *shades, u32 width, u32 height)
+{
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+    std::vector<u8> pixels(width * height * 3);
+
+    for (u32 i = 0; i < width * height; ++i)
+    {
+        u32 colour = SHADE_COLOURS[shades[i] & 0x03];
+        pixels[i * 3 + 0] = (colour >> 16) & 0xFF;
+        pixels[i * 3 + 1] = (colour >> 8) & 0xFF;
+        pixels[i * 3 + 2] = colour & 0xFF;
+    }
+
+    fwrite(pixels.data(), 1, pixels.size(), file);
+
+    return true;
+}
+
+// Encodes a buffer of shades on the calling thread
+bool
+image_write(char *path, u8 *shades, u32 width, u32 height, Image_Format format)
+{
+    FILE *file = fopen(path, "wb");
+
+    if (!file)
+    {
+        printf("[Dump] Unable to write %s\n", path);
+        return false;
+    }
+
+    bool written = format == Image_Format::PNG ? write_png(file, shades, width, height) : write_ppm(file, shades, width, height);
+
+    fclose(file);
+
+    return written;
+}
+
+void
+dumper_thread(Dumper *dumper)
+{
+    for (;;)
+    {
+        Dump_Job job;
+
+        {
+            std::unique_lock<std::mutex> lock(dumper->mutex);
+            dumper->ready.wait(lock, [dumper]() { return !dumper->jobs.empty() || !dumper->running; });
+
+            if (dumper->jobs.empty())
+            {
+                return;
+            }
+
+            job = std::move(dumper->jobs.front());
+            dumper->jobs.pop_front();
+        }
+
+        if (image_write(const_cast<char*>(job.path.c_str()), job.shades.data(), job.width, job.height, dumper->format))
+        {
+            dumper->written++;
+        }
+    }
+}
+
+// Images are named <prefix>_<source>_<frame>.<extension>. every is the number of frames between
+// automatic dumps, 0 to only dump on request
+bool
+dumper_open(Dumper *dumper, char *prefix, Image_Format format, u32 every)
+{
+    dumper->prefix = prefix;
+    dumper->format = format;
+    dumper->every = every;
+    dumper->written = 0;
+    dumper->dropped = 0;
+
+    dumper->running = true;
+    dumper->thread = std::thread(dumper_thread, dumper);
+
+    printf("[Dump] Writing %s images to: %s_*\n", IMAGE_FORMAT_EXTENSIONS[static_cast<u32>(format)], prefix);
+
+    return true;
+}
+
+// Copies the requested buffers and leaves the encoding to the dump thread. The tile and background
+// views are drawn here, the core only keeps the tiles up to date when the VRAM window shows them
+void
+dumper_request(Dumper *dumper, PPU *ppu, Memory_Bus *memory_bus, u8 sources)
+{
+    if (!dumper->running)
+    {
+        return;
+    }
+
+    for (u32 source = 0; source < 3; ++source)
+    {
+        if (!(sources & DUMP_SOURCES[source]))
+        {
+            continue;
+        }
+
+        Dump_Job job;
+
+        switch (DUMP_SOURCES[source])
+        {
+            case DUMP_FRAME:
+                job.width = GAMEBOY_WIDTH;
+                job.height = GAMEBOY_HEIGHT;
+                job.shades.assign(ppu->frame_buffer, ppu->frame_buffer + sizeof(ppu->frame_buffer));
+                break;
+            case DUMP_TILES:
+                ppu_draw_tiles(ppu, memory_bus);
+                job.width = TILE_WINDOW_WIDTH;
+                job.height = TILE_WINDOW_HEIGHT;
+                job.shades.resize(sizeof(ppu->tile_buffer));
+
+                // Flipped in x the same way the VRAM window presents it
+                for (u32 y = 0; y < TILE_WINDOW_HEIGHT; ++y)
+                {
+                    for (u32 x = 0; x < TILE_WINDOW_WIDTH; ++x)
+                    {
+                        job.shades[y * TILE_WINDOW_WIDTH + x] = ppu->tile_buffer[y * TILE_WINDOW_WIDTH + TILE_WINDOW_WIDTH - 1 - x];
+                    }
+                }
+                break;
+            case DUMP_BACKGROUND:
+                ppu_draw_background(ppu, memory_bus);
+                job.width = BACKGROUND_WINDOW_WIDTH;
+                job.height = BACKGROUND_WINDOW_HEIGHT;
+                job.shades.assign(ppu->background_buffer, ppu->background_buffer + sizeof(ppu->background_buffer));
+                break;
+        }
+
+        char path[512];
+        snprintf(path, sizeof(path), "%s_%s_%06llu.%s", dumper->prefix, DUMP_SOURCE_NAMES[source],
+            static_cast<unsigned long long>(ppu->frame_count), IMAGE_FORMAT_EXTENSIONS[static_cast<u32>(dumper->format)]);
+        job.path = path;
+
+        std::lock_guard<std::mutex> lock(dumper->mutex);
+
+        if (dumper->jobs.size() >= DUMP_QUEUE_JOBS)
+        {
+            dumper->dropped++;
+            continue;
+        }
+
+        dumper->jobs.push_back(std::move(job));
+    }
+
+    dumper->ready.notify_one();
+}
+
+// Called with each completed frame, dumps all three images every N frames
+void
+dumper_frame(Dumper *dumper, PPU *ppu, Memory_Bus *memory_bus)
+{
+    if (dumper->running && dumper->every && ppu->frame_count % dumper->every == 0)
+    {
+        dumper_request(dumper, ppu, memory_bus, DUMP_ALL);
+    }
+}
+
+void
+dumper_close(Dumper *dumper)
+{
+    if (!dumper->running)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(dumper->mutex);
+        dumper->running = false;
+    }
+
+    dumper->ready.notify_one();
+    dumper->thread.join();
+
+    printf("[Dump] Wrote %u images, %u dropped\n", dumper->written, dumper->dropped);
+}
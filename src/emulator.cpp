@@ -1,73 +1,73 @@
 #include "emulator.h"
 #include "platform.h"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <cstdio>
 #include <cstring>
 
-const u8 nintendo_logo[48] = {
-    0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
-    0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
-    0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
+struct Key_Binding
+{
+    Input_events::KEY_CODE key;
+    u8 button;
+};
+
+const Key_Binding KEY_BINDINGS[] = {
+    {Input_events::KEY_CODE::A, JOYPAD_A},
+    {Input_events::KEY_CODE::B, JOYPAD_B},
+    {Input_events::KEY_CODE::BACK, JOYPAD_SELECT},
+    {Input_events::KEY_CODE::RETURN, JOYPAD_START},
+    {Input_events::KEY_CODE::RIGHT, JOYPAD_RIGHT},
+    {Input_events::KEY_CODE::LEFT, JOYPAD_LEFT},
+    {Input_events::KEY_CODE::UP, JOYPAD_UP},
+    {Input_events::KEY_CODE::DOWN, JOYPAD_DOWN},
 };
 
+u8
+keyboard_joypad_buttons(Input_events *events)
+{
+    u8 buttons = 0;
+
+    for (const Key_Binding &binding : KEY_BINDINGS)
+    {
+        if (keyboard_down(events, binding.key) || keyboard_held(events, binding.key))
+        {
+            buttons |= binding.button;
+        }
+    }
+
+    return buttons;
+}
+
+void
+on_frame(void *user, PPU *ppu)
+{
+    GameBoy *gb = reinterpret_cast<GameBoy*>(user);
+    video_push_frame(&gb->video, ppu->frame_buffer, ppu->frame_count);
+    dumper_frame(&gb->dumper, ppu, &gb->memory_bus);
+}
+
 bool 
-load_cartridge(Cartridge *cartridge, Memory_Bus *memory_bus)
+load_cartridge(Cartridge *cartridge)
 {
     printf("[Emulator] Loading ROM: %s\n", cartridge->path);
-    cartridge->data = read_file(cartridge->path, &cartridge->size);
 
-    if (cartridge->data == NULL)
+    u64 size;
+    u8 *data = read_file(cartridge->path, &size);
+
+    if (data == NULL)
     {
         message_box("Error", "Error loading rom");
         return false;
     }
 
-    if (cartridge->data[0x0143] == 0xC0)
+    if (!cartridge_load(cartridge, data, size))
     {
         message_box("Error", "CGB only ROM");
         return false;
     }
 
-    cartridge->title = reinterpret_cast<char*>(cartridge->data + 0x0134);
-    cartridge->old_license_code = cartridge->data[0x014B];
-
-    if (cartridge->old_license_code == 0x33)
-    {
-        cartridge->new_license_code[0] = cartridge->data[0x0144];
-        cartridge->new_license_code[0] = cartridge->data[0x0145];
-    }
-   
-    if (memcmp(&nintendo_logo, cartridge->data + 0x104, sizeof(nintendo_logo) / 2) != 0)
-    {
-        printf("[Emulator] Failed license check (nintendo logo)\n");
-    }
-
-    switch (cartridge->data[0x0147])
-    {
-        case 0:
-            printf("[Cartridge] ROM only\n");
-            break;
-        case 1:
-        case 2:
-        case 3:
-            cartridge->mbc1 = true;
-            printf("[Cartridge] MBC1\n");
-            break;
-        case 5:
-        case 6:
-            cartridge->mbc2 = true;
-            printf("[Cartridge] MBC2\n");
-            break;
-        default:
-            break;
-    }
-
-    cartridge->current_rom_bank = 1;
-
-    memset(&cartridge->ram_banks, 0, sizeof(cartridge->ram_banks));
-    cartridge->current_ram_bank = 0;
-
     return true;
 }
 
@@ -79,10 +79,120 @@ init_application(int argc, char **argv, App *app)
         return false;
     }
 
-    GameBoy* state = reinterpret_cast<GameBoy*>(malloc(sizeof(GameBoy)));
+    // Value initialised as the audio sink owns a thread
+    GameBoy* state = new GameBoy();
     
     state->memory_bus.cartridge.path = argv[1];
-    if (!load_cartridge(&state->memory_bus.cartridge, &state->memory_bus))
+
+    char *wav_path = NULL;
+    char *trace_path = NULL;
+    Trace_Level trace_level = Trace_Level::INFO;
+    u64 lockstep_interval = 0;
+    char *record_path = NULL;
+    char *play_path = NULL;
+    char *video_path = NULL;
+    Video_Recorder::Policy video_policy = Video_Recorder::Policy::DROP;
+    char *dump_prefix = NULL;
+    u32 dump_every = 0;
+    Image_Format dump_format = Image_Format::PNG;
+    char *frame_skip = NULL;
+    bool render_thread = false;
+    bool idle_skip = true;
+    state->profile_path = NULL;
+    state->lockstep = NULL;
+
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--wav") == 0 && i + 1 < argc)
+        {
+            wav_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+        {
+            state->profile_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            trace_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--trace-level") == 0 && i + 1 < argc)
+        {
+            if (!trace_parse_level(argv[++i], &trace_level))
+            {
+                printf("[Emulator] Unknown trace level: %s\n", argv[i]);
+            }
+        }
+        else if (strcmp(argv[i], "--lockstep") == 0 && i + 1 < argc)
+        {
+            lockstep_interval = strtoull(argv[++i], NULL, 10);
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            record_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--play") == 0 && i + 1 < argc)
+        {
+            play_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--video") == 0 && i + 1 < argc)
+        {
+            video_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--video-policy") == 0 && i + 1 < argc)
+        {
+            ++i;
+
+            if (strcmp(argv[i], "block") == 0)
+            {
+                video_policy = Video_Recorder::Policy::BLOCK;
+            }
+            else if (strcmp(argv[i], "drop") != 0)
+            {
+                printf("[Emulator] Unknown video policy: %s\n", argv[i]);
+            }
+        }
+        else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+        {
+            dump_prefix = argv[++i];
+        }
+        else if (strcmp(argv[i], "--dump-every") == 0 && i + 1 < argc)
+        {
+            dump_every = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--dump-format") == 0 && i + 1 < argc)
+        {
+            ++i;
+
+            if (strcmp(argv[i], "ppm") == 0)
+            {
+                dump_format = Image_Format::PPM;
+            }
+            else if (strcmp(argv[i], "png") != 0)
+            {
+                printf("[Emulator] Unknown dump format: %s\n", argv[i]);
+            }
+        }
+        else if (strcmp(argv[i], "--frameskip") == 0 && i + 1 < argc)
+        {
+            frame_skip = argv[++i];
+        }
+        else if (strcmp(argv[i], "--render-thread") == 0)
+        {
+            render_thread = true;
+        }
+        else if (strcmp(argv[i], "--no-idle-skip") == 0)
+        {
+            idle_skip = false;
+        }
+    }
+
+    if (state->profile_path && !PROFILER_ENABLED)
+    {
+        printf("[Emulator] --profile ignored, build with EMULATOR_PROFILE defined to enable the profiler\n");
+        state->profile_path = NULL;
+    }
+
+    if (!load_cartridge(&state->memory_bus.cartridge))
     {
         return false;
     }
@@ -92,10 +202,73 @@ init_application(int argc, char **argv, App *app)
 
     printf("[Emulator] STEP MODE: %s\n", state->step ? "enabled" : "disabled");
 
-    memory_bus_init(&state->memory_bus, &state->timers);
-    cpu_init(&state->cpu, &state->memory_bus, false, state->memory_bus.cartridge.old_license_code, state->memory_bus.cartridge.new_license_code);
-    timers_init(&state->timers, &state->memory_bus);
-    ppu_init(&state->ppu, &state->memory_bus);
+    gameboy_init(state);
+    state->idle_skip = idle_skip;
+
+    if (play_path)
+    {
+        movie_play(&state->movie, play_path, &state->memory_bus.cartridge);
+    }
+    else if (record_path)
+    {
+        movie_record(&state->movie, record_path, &state->memory_bus.cartridge);
+    }
+
+    if (lockstep_interval && state->movie.mode != Movie::Mode::NONE)
+    {
+        printf("[Emulator] --lockstep ignored while a movie is recording or playing\n");
+    }
+    else if (lockstep_interval)
+    {
+        state->lockstep = lockstep_create(state, gameboy_run_cycles, lockstep_interval);
+    }
+
+    // Movies and lockstep compare frame hashes, which needs every frame drawn
+    if (frame_skip && (state->lockstep || state->movie.mode != Movie::Mode::NONE))
+    {
+        printf("[Emulator] --frameskip ignored while a movie or lockstep is running\n");
+    }
+    else if (frame_skip && strcmp(frame_skip, "auto") == 0)
+    {
+        state->auto_frame_skip = true;
+    }
+    else if (frame_skip)
+    {
+        state->ppu.frame_skip = strcmp(frame_skip, "all") == 0 ? FRAME_SKIP_ALL : atoi(frame_skip);
+    }
+
+    // Their hashes are also taken between VBLANKs, before the render thread hands over the lines drawn so far
+    if (render_thread && (state->lockstep || state->movie.mode != Movie::Mode::NONE))
+    {
+        printf("[Emulator] --render-thread ignored while a movie or lockstep is running\n");
+    }
+    else if (render_thread)
+    {
+        ppu_start_renderer(&state->ppu, &state->memory_bus);
+    }
+
+    if (trace_path)
+    {
+        trace_open(&state->trace, trace_path, trace_level);
+    }
+
+    if (wav_path && audio_sink_open_wav(&state->audio_sink, &state->apu.ring, wav_path))
+    {
+        apu_set_synthesize(&state->apu, true, state->memory_bus.cycles);
+    }
+
+    if (video_path)
+    {
+        video_open(&state->video, video_path, video_policy);
+    }
+
+    if (dump_prefix)
+    {
+        dumper_open(&state->dumper, dump_prefix, dump_format, dump_every);
+    }
+
+    state->ppu.frame_callback = on_frame;
+    state->ppu.frame_callback_user = state;
 
     state->tile_window = create_window(TILE_WINDOW_HEIGHT * RESOLUTION_UPSCALE, TILE_WINDOW_WIDTH * RESOLUTION_UPSCALE, "VRAM");
 
@@ -104,6 +277,8 @@ init_application(int argc, char **argv, App *app)
         return false;
     }
 
+    state->ppu.debug_views = true;
+
     app->window_title = reinterpret_cast<char*>(std::malloc(255));
     std::memset(app->window_title, 0, 255);
     app->window_title[0] = 'G';
@@ -133,6 +308,25 @@ init_application(int argc, char **argv, App *app)
 const i64 dmg_cycle_time_ns = 238;
 const i64 simulation_period = 1.6e+7 / 2;
 
+constexpr u32 MAX_AUTO_FRAME_SKIP = 4;
+
+// Skips one more frame while emulating a batch takes most of the real time it covers, and one fewer
+// once there is plenty to spare
+void
+adjust_frame_skip(GameBoy *gb, i64 elapsed_ns, i64 emulated_ns)
+{
+    if (elapsed_ns * 10 > emulated_ns * 9 && gb->ppu.frame_skip < MAX_AUTO_FRAME_SKIP)
+    {
+        gb->ppu.frame_skip++;
+        printf("[Emulator] Frameskip %u\n", gb->ppu.frame_skip);
+    }
+    else if (elapsed_ns * 2 < emulated_ns && gb->ppu.frame_skip > 0)
+    {
+        gb->ppu.frame_skip--;
+        printf("[Emulator] Frameskip %u\n", gb->ppu.frame_skip);
+    }
+}
+
 void
 update_application(App *app, i64 delta_time) 
 {
@@ -150,21 +344,34 @@ update_application(App *app, i64 delta_time)
         return;
     }
 
-    CPU *cpu = &gb->cpu;
-    Timers *timers = &gb->timers;
-    PPU *ppu = &gb->ppu;
-    Memory_Bus *memory_bus = &gb->memory_bus;
-
     i64 cycles_to_simulate = gb->time_since_last_sim / dmg_cycle_time_ns;
 
-    printf("time/period: %lld/%lld cycles: %lld\n", gb->time_since_last_sim, simulation_period, cycles_to_simulate);
+    trace_event(&gb->trace, Trace_Level::DEBUG, Trace_Event::SIMULATION_BATCH, gb->memory_bus.cycles, static_cast<u32>(cycles_to_simulate), static_cast<u32>(gb->time_since_last_sim / 1000));
 
-    for (i64 i = 0; i < cycles_to_simulate; ++i)
+    auto start = std::chrono::steady_clock::now();
+
+    if (gb->lockstep)
+    {
+        if (!lockstep_run_cycles(gb->lockstep, cycles_to_simulate))
+        {
+            gb->pause = true;
+        }
+    }
+    else if (gb->movie.mode != Movie::Mode::NONE)
+    {
+        movie_run_cycles(&gb->movie, gb, cycles_to_simulate);
+    }
+    else
+    {
+        gameboy_run_cycles(gb, cycles_to_simulate);
+    }
+
+    apu_end_block(&gb->apu, gb->memory_bus.cycles);
+
+    if (gb->auto_frame_skip)
     {
-        cpu_cycle(cpu, memory_bus);
-        timers_cycle(timers, memory_bus);
-        ppu_cycle(ppu, memory_bus);
-        handle_input_event(memory_bus);
+        i64 elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        adjust_frame_skip(gb, elapsed_ns, cycles_to_simulate * dmg_cycle_time_ns);
     }
 
     gb->time_since_last_sim = 0;
@@ -198,8 +405,58 @@ handle_input(App *app, Input_events *input_events)
             gb->pause = false;
         }
     }
+    else if (keyboard_up(input_events, Input_events::KEY_CODE::P))
+    {
+        dumper_request(&gb->dumper, &gb->ppu, &gb->memory_bus, DUMP_ALL);
+    }
+
+    // A playing movie owns the joypad until it ends
+    if (gb->movie.mode == Movie::Mode::PLAY)
+    {
+        return;
+    }
+
+    u8 buttons = keyboard_joypad_buttons(input_events);
+
+    if (buttons == gb->memory_bus.joypad.buttons)
+    {
+        return;
+    }
+
+    joypad_set_buttons(&gb->memory_bus, buttons);
+    movie_record_input(&gb->movie, buttons, gb->memory_bus.cycles);
+
+    if (gb->lockstep)
+    {
+        joypad_set_buttons(&gb->lockstep->reference->memory_bus, buttons);
+    }
+}
+
+void
+shutdown_application(App *app)
+{
+    GameBoy *gb = reinterpret_cast<GameBoy*>(app->application);
+
+    movie_close(&gb->movie, gb);
+
+    ppu_stop_renderer(&gb->ppu);
+
+    apu_end_block(&gb->apu, gb->memory_bus.cycles);
+    audio_sink_close(&gb->audio_sink, &gb->apu.ring);
+    video_close(&gb->video);
+    dumper_close(&gb->dumper);
+
+    if (gb->profile_path)
+    {
+        profiler_write_report(&gb->profiler, gb->profile_path);
+    }
+
+    trace_close(&gb->trace);
 
-    set_joypad_state(input_events, &gb->memory_bus.joypad);
+    if (gb->lockstep)
+    {
+        lockstep_destroy(gb->lockstep);
+    }
 }
 
 void 
@@ -217,7 +474,7 @@ render_application(App *app, u32 *screen_pixels, i32 width, i32 height)
         {
             for (i32 j = 0 ; j < GAMEBOY_HEIGHT ; ++j)
             {
-                u32 pixel = gb->ppu.frame_buffer[i + GAMEBOY_WIDTH * j];
+                u32 pixel = SHADE_COLOURS[gb->ppu.frame_buffer[i + GAMEBOY_WIDTH * j]];
 
                 // Need to flip in x to for the windows buffer
                 i32 adjusted_i = i * RESOLUTION_UPSCALE;
@@ -226,7 +483,7 @@ render_application(App *app, u32 *screen_pixels, i32 width, i32 height)
                 {
                     i32 adjusted_j = height - 1 - (j * RESOLUTION_UPSCALE) - k;
                     i32 index = adjusted_i + width * adjusted_j;
-                    std::memset(screen_pixels + index , pixel, sizeof(u32) * RESOLUTION_UPSCALE);
+                    std::fill_n(screen_pixels + index, RESOLUTION_UPSCALE, pixel);
                 }
             }
         }
@@ -248,7 +505,7 @@ render_application(App *app, u32 *screen_pixels, i32 width, i32 height)
         {
             for (i32 j = TILE_WINDOW_HEIGHT - 1; j  >=0 ; --j)
             {
-                u32 pixel = gb->ppu.tile_buffer[i + TILE_WINDOW_WIDTH * j];
+                u32 pixel = SHADE_COLOURS[gb->ppu.tile_buffer[i + TILE_WINDOW_WIDTH * j]];
 
                 // Need to flip in x to for the windows buffer
                 i32 adjusted_i = (TILE_WINDOW_WIDTH - 1 - i) * RESOLUTION_UPSCALE;
@@ -257,7 +514,7 @@ render_application(App *app, u32 *screen_pixels, i32 width, i32 height)
                 {
                     i32 adjusted_j = tile_frame_height - 1 - (j * RESOLUTION_UPSCALE) - k;
                     i32 index = adjusted_i + tile_frame_width * adjusted_j;
-                    std::memset(tile_pixels + index , pixel, sizeof(u32) * RESOLUTION_UPSCALE);
+                    std::fill_n(tile_pixels + index, RESOLUTION_UPSCALE, pixel);
                 }
             }
         }
@@ -2,14 +2,25 @@
 
 #include "types.h"
 #include "platform.h"
+#include "hash.h"
+#include "profiler.h"
+#include "trace.h"
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
 #include <deque>
 #include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 // General
 constexpr u8 GAMEBOY_WIDTH = 160;
 constexpr u8 GAMEBOY_HEIGHT = 144;
 constexpr u8 RESOLUTION_UPSCALE = 4;
+constexpr u32 CYCLES_PER_FRAME = 70224;
 
 constexpr u16 TILE_COUNT = 384;
 constexpr u16 TILE_WINDOW_WIDTH = 192;
@@ -32,7 +43,23 @@ constexpr u16 CARTRIDGE_TITLE = 0x0134;
 constexpr u16 SOUND_CONTROLLER_ON_OF = 0xFF26;
 
 // PPU
+constexpr u16 LCD_CONTROL_REGISTER = 0xFF40;
+constexpr u16 LCD_STATUS_REGISTER = 0xFF41;
 constexpr u16 LY_REGISTER = 0xFF44;
+constexpr u16 LYC_REGISTER = 0xFF45;
+
+constexpr u16 OAM_START_ADDRESS = 0xFE00;
+constexpr u16 OAM_END_ADDRESS = 0xFE9F;
+constexpr u8 OAM_SPRITE_COUNT = 40;
+constexpr u8 SPRITES_PER_LINE = 10;
+constexpr u16 VRAM_TILE_DATA_ADDRESS = 0x8000;
+constexpr u32 FRAME_SKIP_ALL = 0xFFFFFFFF; // PPU::frame_skip value that never draws
+constexpr u16 VRAM_TILE_MAP_ADDRESS = 0x9800; // two 32x32 maps follow the tile data
+
+// Shades written by the PPU, 0 is white and 3 is black. The colours the presenter, image dumps and
+// video header map them to
+constexpr u32 SHADE_COLOURS[] = {0x00FFFFFF, 0x00FFAAAA, 0x00FF5555, 0x00000000};
+constexpr u8 SHADE_LUMINANCE[] = {0xFF, 0xAA, 0x55, 0x00};
 
 // Timers
 constexpr u16 DIV = 0xFF04;
@@ -44,11 +71,62 @@ constexpr u16 DMA_REGISTER = 0xFF46;
 constexpr u16 JOYPAD_REGISTER = 0xFF00;
 constexpr u16 SERIAL_DATA_TRANSFER = 0xFF01;
 
+// APU
+constexpr u16 APU_REGISTER_START = 0xFF10;
+constexpr u16 APU_REGISTER_END = 0xFF3F;
+constexpr u16 WAVE_RAM_START = 0xFF30;
+
+constexpr u32 DMG_CLOCK_RATE = 4194304;
+constexpr u32 AUDIO_SAMPLE_RATE = 44100;
+constexpr u32 AUDIO_RING_BUFFER_SIZE = 1 << 15; // interleaved stereo samples, must be a power of two
+
+// Band-limited step synthesis. A block of at most APU_MAX_BLOCK_CYCLES is synthesised before the
+// buffer is drained so BLIP_BUFFER_SIZE only needs to hold one block worth of samples plus the kernel tail
+constexpr u32 APU_MAX_BLOCK_CYCLES = 1 << 16;
+constexpr u32 BLIP_BUFFER_SIZE = 1024;
+constexpr u32 BLIP_KERNEL_WIDTH = 16;
+constexpr u32 BLIP_PHASE_BITS = 5;
+constexpr u32 BLIP_PHASE_COUNT = 1 << BLIP_PHASE_BITS;
+
+constexpr u32 RENDER_QUEUE_SIZE = 1 << 14; // must be a power of two
+
+constexpr u32 VIDEO_QUEUE_FRAMES = 16;
+
+// Buffers dumper_request can write, combined as a mask
+constexpr u8 DUMP_FRAME = 0x01;
+constexpr u8 DUMP_TILES = 0x02;
+constexpr u8 DUMP_BACKGROUND = 0x04;
+constexpr u8 DUMP_ALL = DUMP_FRAME | DUMP_TILES | DUMP_BACKGROUND;
+constexpr u32 DUMP_QUEUE_JOBS = 32;
+
 constexpr u8 JOYPAD_DIRECTION_REQUEST = 0x10;
 constexpr u8 JOYPAD_BUTTON_REQUEST = 0x20;
 
+// Button mask bits, set while the button is held. The low nibble matches the P1 button lines and the
+// high nibble the direction lines
+constexpr u8 JOYPAD_A = 0x01;
+constexpr u8 JOYPAD_B = 0x02;
+constexpr u8 JOYPAD_SELECT = 0x04;
+constexpr u8 JOYPAD_START = 0x08;
+constexpr u8 JOYPAD_RIGHT = 0x10;
+constexpr u8 JOYPAD_LEFT = 0x20;
+constexpr u8 JOYPAD_UP = 0x40;
+constexpr u8 JOYPAD_DOWN = 0x80;
+
 constexpr u64 CPU_PIPELINE_SIZE = 12;
 
+constexpr u32 IDLE_LOOP_CYCLES = 32; // longest loop iteration that is recorded
+constexpr u16 IDLE_LOOP_BYTES = 16; // furthest backward JR that starts a recording
+constexpr u32 IDLE_REJECT_SLOTS = 16;
+
+// Memory bank controller, picks the banking write handler when the bus is initialised
+enum class Mapper : u8
+{
+    ROM_ONLY,
+    MBC1,
+    MBC2
+};
+
 struct Cartridge
 {
     char *path;
@@ -57,8 +135,7 @@ struct Cartridge
 
     char *title;
 
-    bool mbc1;
-    bool mbc2;
+    Mapper mapper;
 
     bool rom_bank_enabled;
     bool ram_bank_enabled;
@@ -71,6 +148,11 @@ struct Cartridge
     u8 ram_banks[4 * 0x2000];
 };
 
+struct PPU;
+struct Scanline_Renderer;
+
+typedef void (*Frame_Callback)(void *user, PPU *ppu);
+
 struct PPU
 {
     enum class Mode
@@ -99,8 +181,8 @@ struct PPU
             };
         };
 
-        i8 y_pos;
-        i8 x_pos;
+        i16 y_pos; // screen position of the top left pixel
+        i16 x_pos;
         u8 tile;
         Sprite_Flags properties;
     };
@@ -111,16 +193,96 @@ struct PPU
     u8 window_line_counter;
     bool window_used;
 
-    OAM_Entry oam_object[40];
-    bool valid_oam_objects[40];
-
-    u32 tile_buffer[TILE_WINDOW_WIDTH * TILE_WINDOW_HEIGHT];
-    u32 background_buffer[BACKGROUND_WINDOW_WIDTH * BACKGROUND_WINDOW_HEIGHT];
+    OAM_Entry oam_object[OAM_SPRITE_COUNT]; // decoded on every OAM write and DMA
+
+    // The sprites drawn on each line in DMG priority order (x, then OAM index), rebuilt at the next
+    // OAM scan after OAM or the sprite height changes
+    u8 line_sprites[GAMEBOY_HEIGHT][SPRITES_PER_LINE];
+    u8 line_sprite_count[GAMEBOY_HEIGHT];
+    u8 sprite_index_height;
+    bool sprite_index_dirty;
+
+    // Both background maps drawn as 256x256 colour ids, before the palette. A cell is redrawn when its
+    // map entry selects a different tile or that tile's data changed since it was drawn
+    u8 map_cache[2][BACKGROUND_WINDOW_WIDTH * BACKGROUND_WINDOW_HEIGHT];
+    u16 map_cell_tile[2][32 * 32]; // index into tile data, 0xFFFF when the cell was never drawn
+    u32 map_cell_version[2][32 * 32];
+    u32 tile_version[TILE_COUNT]; // bumped by every VRAM write that changes a tile
+
+    // tile_buffer holds raw colour ids (0-3) since tiles have no palette of their own, the other
+    // buffers hold shades (0 white to 3 black) after the palette registers are applied. Colour
+    // conversion is left to whoever presents or encodes them
+    u8 tile_buffer[TILE_WINDOW_WIDTH * TILE_WINDOW_HEIGHT];
+    u8 background_buffer[BACKGROUND_WINDOW_WIDTH * BACKGROUND_WINDOW_HEIGHT];
     
-    u32 frame_buffer[GAMEBOY_WIDTH * GAMEBOY_HEIGHT];
-
+    u8 frame_buffer[GAMEBOY_WIDTH * GAMEBOY_HEIGHT];
+
+    u64 frame_count; // frames completed, incremented when VBLANK starts
+
+    // Frames left undrawn after each drawn one. A skipped frame runs modes, LY, STAT and interrupts
+    // as usual but writes no pixels, frame_buffer keeps the last drawn frame
+    u32 frame_skip;
+    bool skip_frame; // the current frame is not drawn
+
+    // Luminance averaged over downscale x downscale blocks, written a row at a time as lines are
+    // drawn. Holds the last observation_stack frames oldest first, NULL when nothing observes
+    u8 *observation;
+    u8 observation_downscale;
+    u8 observation_stack;
+    u16 observation_sums[GAMEBOY_WIDTH]; // shade sums of the block row being drawn
+    bool lcd_off; // asleep until LCDC enables the LCD again
+    bool stat_line; // OR of the enabled STAT interrupt sources
     bool draw_frame;
     bool draw_tile_buffer;
+    bool debug_views; // tile_buffer is drawn with each drawn frame, only the VRAM window needs it
+
+    // Called on the emulation thread as each drawn frame completes, NULL when nobody is listening
+    Frame_Callback frame_callback;
+    void *frame_callback_user;
+
+    // NULL draws each line on the emulation thread as its pixel transfer starts. Otherwise the render
+    // thread owns everything above that is derived from VRAM and OAM
+    Scanline_Renderer *renderer;
+};
+
+// The registers a line is drawn with, latched as its pixel transfer starts
+struct PPU_Line_Registers
+{
+    u8 lcdc;
+    u8 scy;
+    u8 scx;
+    u8 wy;
+    u8 wx;
+    u8 bgp;
+    u8 obp[2];
+    u8 window_line; // line of the window map shown, when the window is visible
+};
+
+// Draws lines on a second thread from its own copy of VRAM and OAM. The emulation thread queues
+// every VRAM and OAM write in order, with a command to draw each line once its registers are latched,
+// and takes the finished frame at VBLANK
+struct Scanline_Renderer
+{
+    struct Command
+    {
+        u16 address; // VRAM or OAM byte written, 0 to draw a line
+        u8 value; // the byte written or the line to draw
+    };
+
+    Command queue[RENDER_QUEUE_SIZE];
+    std::atomic<u32> read;
+    std::atomic<u32> write;
+
+    PPU_Line_Registers lines[GAMEBOY_HEIGHT];
+    u8 vram[0x2000];
+    u8 oam[OAM_END_ADDRESS - OAM_START_ADDRESS + 1];
+    u8 frame_buffer[GAMEBOY_WIDTH * GAMEBOY_HEIGHT]; // the frame being drawn
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable drained;
+    bool running;
 };
 
 struct Timers
@@ -133,9 +295,141 @@ struct Timers
 
 struct Joypad
 {
-    u8 state;
-    bool button;
-    bool direction;
+    u8 buttons;
+    u8 p1[4]; // P1 read value for every combination of the select bits 4 and 5
+};
+
+struct Blip_Buffer
+{
+    u64 factor; // output samples per clock in 32.32 fixed point
+    u64 offset; // fractional sample position carried over from the previous block
+    i32 integrator;
+    i32 samples[BLIP_BUFFER_SIZE + BLIP_KERNEL_WIDTH];
+};
+
+// Single producer (emulation thread) single consumer (audio sink) queue of interleaved stereo samples
+struct Audio_Ring_Buffer
+{
+    std::atomic<u32> read;
+    std::atomic<u32> write;
+    i16 samples[AUDIO_RING_BUFFER_SIZE];
+};
+
+struct APU
+{
+    struct Channel
+    {
+        bool enabled;
+        bool dac_enabled;
+        bool length_enabled;
+        u16 length_counter;
+        u16 frequency;
+        u32 timer; // cycles until the next waveform step
+        u8 position; // duty step for the pulse channels, sample index for the wave channel
+        u8 volume;
+        u8 envelope_period;
+        u8 envelope_timer;
+        bool envelope_increase;
+        u16 lfsr;
+        u8 output; // 4 bit digital output before the DAC
+        i32 amplitude[2]; // last amplitude given to the left and right blip buffers
+    };
+
+    Channel channels[4];
+
+    u16 sweep_shadow;
+    u8 sweep_timer;
+    bool sweep_enabled;
+
+    u8 sequencer_step;
+    u32 sequencer_timer;
+
+    u8 registers[APU_REGISTER_END - APU_REGISTER_START + 1]; // raw NR10 - NR52 and wave RAM
+
+    u64 block_start; // bus cycle the current synthesis block started at
+    u32 time; // cycles into the current block that have been emulated
+    bool synthesize; // when false registers and channel state are kept up to date but no samples are produced
+
+    Blip_Buffer blip[2];
+    Audio_Ring_Buffer ring;
+};
+
+struct Audio_Sink
+{
+    enum class Type : u8
+    {
+        NONE, // samples are never produced
+        WAV,
+    } type;
+
+    FILE *file;
+    u32 data_size;
+
+    std::thread thread;
+    std::atomic<bool> running;
+};
+
+// Streams completed frames to disk from a background thread. Frames identical to the previous one
+// are skipped and the emulation thread only copies the frame into a bounded queue
+struct Video_Recorder
+{
+    enum class Policy : u8
+    {
+        DROP, // a full queue drops the frame, the emulator never waits on the disk
+        BLOCK, // a full queue stalls the emulator until the writer catches up
+    } policy;
+
+    FILE *file;
+
+    u8 *queue; // VIDEO_QUEUE_FRAMES shade frames
+    u64 queue_frame[VIDEO_QUEUE_FRAMES];
+    u32 read;
+    u32 write;
+
+    u8 last[GAMEBOY_WIDTH * GAMEBOY_HEIGHT]; // last frame queued, for deduplication
+    bool has_last;
+
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable space;
+    std::thread thread;
+    bool running;
+
+    u64 frames_written;
+    u64 frames_duplicated;
+    u64 frames_dropped;
+    u64 bytes_written;
+};
+
+enum class Image_Format : u8
+{
+    PNG,
+    PPM,
+};
+
+struct Dump_Job
+{
+    std::string path;
+    u32 width;
+    u32 height;
+    std::vector<u8> shades;
+};
+
+// Writes PPU buffers as images from a background thread, on request or every N frames
+struct Dumper
+{
+    char *prefix;
+    Image_Format format;
+    u32 every;
+
+    std::deque<Dump_Job> jobs; // at most DUMP_QUEUE_JOBS, later requests are dropped
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::thread thread;
+    bool running;
+
+    u32 written;
+    u32 dropped;
 };
 
 struct Memory_Bus
@@ -144,6 +438,14 @@ struct Memory_Bus
     Cartridge cartridge;
     Joypad joypad;
     Timers *timers;
+    PPU *ppu;
+    APU *apu;
+    Profiler *profiler;
+    Trace *trace;
+
+    u64 cycles; // T cycles since power on, used to timestamp register writes
+    u8 interrupts_pending; // IF & IE, kept up to date by writes to either
+    void (*handle_banking)(Memory_Bus *memory_bus, u16 address, u8 v); // specialised for the cartridge's mapper
 
     void write_u8(u16 address, u8 v);
     u8 read_u8(u16 address);
@@ -168,11 +470,14 @@ struct CPU
     bool interrupt_master_enable;
     bool halted;
     bool extended;
+    bool jumped_back; // a JR just went back at most IDLE_LOOP_BYTES, cleared by the idle loop watch
+    u8 dispatch_cycle;
 
     enum class STATE : u8 
     {
         READ_OPCODE, 
-        EXECUTE_PIPELINE
+        EXECUTE_PIPELINE,
+        DISPATCH_INTERRUPT
     } state;
 
     struct Pipeline
@@ -192,9 +497,37 @@ struct CPU
     Pipeline pipeline;
 };
 
+// A loop that polls one byte, or nothing at all, waiting for the timers, the PPU or an interrupt to
+// change it. One iteration is recorded with the CPU state before each of its cycles, after that only
+// the timers and the PPU run until the polled byte changes or an interrupt is pending, and the CPU is
+// put back to the recorded state of the cycle where that happened
+struct Idle_Loop
+{
+    enum class State : u8
+    {
+        WATCH,
+        RECORD,
+        SKIP,
+    } state;
+
+    u16 start;
+    u16 unsettled; // start of the last loop that did not come back to the state it started in
+    u16 address;
+    u8 value;
+    bool polling; // whether address is read by the loop
+    bool interrupts; // IME inside the loop
+
+    u32 length; // cycles per iteration
+    u32 phase;
+
+    u16 rejected[IDLE_REJECT_SLOTS]; // loop starts that can never be skipped, by pc
+    CPU recording[IDLE_LOOP_CYCLES];
+};
+
 void perform_interrupt(Memory_Bus *memory_bus, u8 flag);
 
-void memory_bus_init(Memory_Bus *memory_bus, Timers *timers);
+void memory_bus_init(Memory_Bus *memory_bus, Timers *timers, PPU *ppu, APU *apu, Profiler *profiler, Trace *trace);
+void memory_bus_update_interrupts(Memory_Bus *memory_bus);
 
 void timers_cycle(Timers *timers, Memory_Bus *memory_bus);
 void timers_init(Timers *timers, Memory_Bus *memory_bus);
@@ -202,12 +535,95 @@ void timers_set_tac(Timers *timers, u8 mode);
 
 void cpu_init(CPU *cpu, Memory_Bus *memory_bus, bool cgb, u8 old_licence_code, u8 new_license_code[2]);
 void cpu_cycle(CPU *cpu, Memory_Bus *memory_bus);
+void cpu_cycle_reference(CPU *cpu, Memory_Bus *memory_bus);
+bool cpu_polling_instruction(CPU *cpu, Memory_Bus *memory_bus, u16 *address, bool *reads);
 
 void ppu_init(PPU *ppu, Memory_Bus *memory_bus);
-void ppu_cycle(PPU *ppu, Memory_Bus *memory_bus);
+template <bool Debug_Views, bool Reference> void ppu_cycle(PPU *ppu, Memory_Bus *memory_bus);
+void ppu_draw_tiles(PPU *ppu, Memory_Bus *memory_bus);
+void ppu_draw_background(PPU *ppu, Memory_Bus *memory_bus);
+void ppu_update_stat(PPU *ppu, Memory_Bus *memory_bus);
+void ppu_write_vram(PPU *ppu, Memory_Bus *memory_bus, u16 address, u8 value);
+void ppu_write_oam(PPU *ppu, Memory_Bus *memory_bus, u16 address);
+void ppu_invalidate_caches(PPU *ppu, Memory_Bus *memory_bus);
+bool ppu_start_renderer(PPU *ppu, Memory_Bus *memory_bus);
+void ppu_stop_renderer(PPU *ppu);
+void ppu_render_sync(PPU *ppu);
+bool ppu_set_observation(PPU *ppu, u8 *buffer, u8 downscale, u8 stack);
+
+void apu_init(APU *apu, bool synthesize);
+void apu_write(APU *apu, u16 address, u8 v, u64 now);
+u8 apu_read(APU *apu, u16 address, u64 now);
+void apu_end_block(APU *apu, u64 now);
+void apu_set_synthesize(APU *apu, bool synthesize, u64 now);
+
+void audio_ring_init(Audio_Ring_Buffer *ring);
+u32 audio_ring_write(Audio_Ring_Buffer *ring, i16 *samples, u32 count);
+u32 audio_ring_read(Audio_Ring_Buffer *ring, i16 *samples, u32 count);
+
+bool audio_sink_open_wav(Audio_Sink *sink, Audio_Ring_Buffer *ring, char *path);
+void audio_sink_close(Audio_Sink *sink, Audio_Ring_Buffer *ring);
+
+// Largest PackBits encoding rle_encode produces for size bytes, one header per 128 literal bytes
+constexpr u32
+rle_encoded_bound(u32 size)
+{
+    return size + (size + 127) / 128;
+}
+
+u32 rle_encode(u8 *in, u32 size, u8 *out);
+u32 rle_decode(u8 *in, u32 size, u8 *out, u32 capacity);
+
+bool video_open(Video_Recorder *video, char *path, Video_Recorder::Policy policy);
+void video_push_frame(Video_Recorder *video, u8 *frame, u64 frame_number);
+void video_close(Video_Recorder *video);
+
+bool image_write(char *path, u8 *shades, u32 width, u32 height, Image_Format format);
+bool dumper_open(Dumper *dumper, char *prefix, Image_Format format, u32 every);
+void dumper_request(Dumper *dumper, PPU *ppu, Memory_Bus *memory_bus, u8 sources);
+void dumper_frame(Dumper *dumper, PPU *ppu, Memory_Bus *memory_bus);
+void dumper_close(Dumper *dumper);
+
+void joypad_init(Joypad *joypad);
+void joypad_set_buttons(Memory_Bus *memory_bus, u8 buttons);
+void joypad_write_select(Memory_Bus *memory_bus, u8 v);
+
+// Joypad changes keyed by the bus cycle they happened at, plus a frame hash checkpoint every emulated
+// second so a replay can prove it reached the same state
+struct Movie_Event
+{
+    enum class Type : u8
+    {
+        INPUT,
+        CHECKPOINT,
+        END
+    } type;
+
+    u64 cycle;
+    u8 buttons; // INPUT
+    u64 frame_hash; // CHECKPOINT and END
+};
+
+struct Movie
+{
+    enum class Mode : u8
+    {
+        NONE,
+        RECORD,
+        PLAY
+    } mode;
 
-void handle_input_event(Memory_Bus *memory_bus);
-void set_joypad_state(Input_events *events, Joypad *joypad);
+    char *path;
+    u64 rom_hash;
+    std::vector<Movie_Event> events;
+    u32 position; // next event to apply when playing
+    u64 next_checkpoint;
+
+    u32 checkpoints_matched;
+    u32 checkpoints_failed;
+};
+
+struct Lockstep;
 
 struct GameBoy
 {
@@ -215,12 +631,112 @@ struct GameBoy
     CPU cpu;
     Timers timers;
     PPU ppu;
+    APU apu;
+    Audio_Sink audio_sink;
+    Video_Recorder video;
+    Dumper dumper;
+    Profiler profiler;
+    Trace trace;
+    Movie movie;
+    Idle_Loop idle;
 
     i64 time_since_last_sim;
 
+    bool idle_skip; // polling loops are skipped by gameboy_run_cycles and gameboy_run_until
+
+    bool auto_frame_skip; // PPU::frame_skip follows how much of real time emulation takes
+
     bool pause;
     bool step;
 
+    char *profile_path;
+
+    Lockstep *lockstep; // NULL unless a reference core shadows this one
+
     Window *tile_window;
     Window *background_window;
-};
\ No newline at end of file
+};
+
+bool cartridge_load(Cartridge *cartridge, u8 *data, u64 size);
+
+// Stop condition for gameboy_run_until, checked after every cycle by a loop specialised per type
+struct Run_Condition
+{
+    enum class Type : u8
+    {
+        PC, // an instruction at address is about to execute
+        LY, // LY equals value
+        MEMORY_CHANGE, // the byte at address differs from its value when the run started
+        FRAMES, // frames more frames have completed
+    } type;
+
+    u16 address;
+    u8 value;
+    u64 frames;
+};
+
+void gameboy_init(GameBoy *gb);
+void gameboy_run_cycles(GameBoy *gb, u64 cycles);
+void gameboy_run_reference_cycles(GameBoy *gb, u64 cycles);
+bool gameboy_run_until(GameBoy *gb, Run_Condition condition, u64 max_cycles);
+bool gameboy_run_frame(GameBoy *gb);
+u64 gameboy_frame_hash(GameBoy *gb);
+
+// N GameBoys running the same ROM in one allocation, stepped a frame at a time by a thread pool.
+// After each step observations holds one downscaled 8 bit grayscale image per instance
+struct Batch
+{
+    GameBoy *gameboys;
+    u32 count;
+
+    u8 downscale;
+    u8 stack;
+    u32 observation_width;
+    u32 observation_height;
+    u8 *observations; // count * stack * observation_height * observation_width
+
+    u8 *buttons; // held buttons of every instance for the current step
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+    u64 generation; // incremented for every step, guarded by mutex
+    bool running;
+    std::atomic<u32> next; // next instance to claim
+    std::atomic<u32> completed;
+};
+
+Batch * batch_create(u8 *rom, u64 size, u32 count, u32 threads, u8 downscale, u8 stack);
+void batch_destroy(Batch *batch);
+void batch_step(Batch *batch, u8 *buttons);
+
+u64 gameboy_save_state(GameBoy *gb, u8 *buffer, u64 capacity);
+bool gameboy_load_state(GameBoy *gb, u8 *buffer, u64 size);
+
+bool movie_record(Movie *movie, char *path, Cartridge *cartridge);
+bool movie_play(Movie *movie, char *path, Cartridge *cartridge);
+void movie_record_input(Movie *movie, u8 buttons, u64 cycle);
+void movie_run_cycles(Movie *movie, GameBoy *gb, u64 cycles);
+void movie_close(Movie *movie, GameBoy *gb);
+
+typedef void (*Run_Cycles_Function)(GameBoy *gb, u64 cycles);
+
+// Runs a candidate core in lockstep with the reference one (gameboy_run_reference_cycles) on the same
+// ROM and input. The reference is stepped one instruction at a time, every interval instructions the
+// candidate is brought to the same cycle and registers plus hashes of memory and the frame buffer are compared
+struct Lockstep
+{
+    GameBoy *reference;
+    GameBoy *candidate;
+    Run_Cycles_Function candidate_run;
+
+    u64 interval; // instructions between comparisons
+    u64 instructions;
+    u64 comparisons;
+    bool diverged;
+};
+
+Lockstep * lockstep_create(GameBoy *candidate, Run_Cycles_Function candidate_run, u64 interval);
+void lockstep_destroy(Lockstep *lockstep);
+bool lockstep_run_cycles(Lockstep *lockstep, u64 cycles);
\ No newline at end of file
@@ -0,0 +1,522 @@
+#include "emulator.h"
+
+#include <cstdio>
+#include <cstring>
+
+const u8 nintendo_logo[48] = {
+    0xCE, 0xED, 0x66, 0x66, 0xCC, 0x0D, 0x00, 0x0B, 0x03, 0x73, 0x00, 0x83, 0x00, 0x0C, 0x00, 0x0D,
+    0x00, 0x08, 0x11, 0x1F, 0x88, 0x89, 0x00, 0x0E, 0xDC, 0xCC, 0x6E, 0xE6, 0xDD, 0xDD, 0xD9, 0x99,
+    0xBB, 0xBB, 0x67, 0x63, 0x6E, 0x0E, 0xEC, 0xCC, 0xDD, 0xDC, 0x99, 0x9F, 0xBB, 0xB9, 0x33, 0x3E
+};
+
+bool
+cartridge_load(Cartridge *cartridge, u8 *data, u64 size)
+{
+    cartridge->data = data;
+    cartridge->size = size;
+
+    if (cartridge->data[0x0143] == 0xC0)
+    {
+        printf("[Cartridge] CGB only ROM\n");
+        return false;
+    }
+
+    cartridge->title = reinterpret_cast<char*>(cartridge->data + 0x0134);
+    cartridge->old_license_code = cartridge->data[0x014B];
+
+    if (cartridge->old_license_code == 0x33)
+    {
+        cartridge->new_license_code[0] = cartridge->data[0x0144];
+        cartridge->new_license_code[0] = cartridge->data[0x0145];
+    }
+
+    if (memcmp(&nintendo_logo, cartridge->data + 0x104, sizeof(nintendo_logo) / 2) != 0)
+    {
+        printf("[Emulator] Failed license check (nintendo logo)\n");
+    }
+
+    cartridge->mapper = Mapper::ROM_ONLY;
+
+    switch (cartridge->data[0x0147])
+    {
+        case 0:
+            printf("[Cartridge] ROM only\n");
+            break;
+        case 1:
+        case 2:
+        case 3:
+            cartridge->mapper = Mapper::MBC1;
+            printf("[Cartridge] MBC1\n");
+            break;
+        case 5:
+        case 6:
+            cartridge->mapper = Mapper::MBC2;
+            printf("[Cartridge] MBC2\n");
+            break;
+        default:
+            break;
+    }
+
+    cartridge->current_rom_bank = 1;
+
+    memset(&cartridge->ram_banks, 0, sizeof(cartridge->ram_banks));
+    cartridge->current_ram_bank = 0;
+
+    return true;
+}
+
+// Resets every component, the cartridge must already be loaded
+void
+gameboy_init(GameBoy *gb)
+{
+    profiler_init(&gb->profiler);
+    trace_init(&gb->trace);
+
+    memory_bus_init(&gb->memory_bus, &gb->timers, &gb->ppu, &gb->apu, &gb->profiler, &gb->trace);
+    cpu_init(&gb->cpu, &gb->memory_bus, false, gb->memory_bus.cartridge.old_license_code, gb->memory_bus.cartridge.new_license_code);
+    timers_init(&gb->timers, &gb->memory_bus);
+    ppu_init(&gb->ppu, &gb->memory_bus);
+
+    // Without a sink there is nobody to hear the samples so the APU only keeps its registers up to date
+    apu_init(&gb->apu, false);
+
+    gb->idle.state = Idle_Loop::State::WATCH;
+    gb->idle.unsettled = 0xFFFF;
+    memset(gb->idle.rejected, 0xFF, sizeof(gb->idle.rejected));
+    gb->idle_skip = true;
+}
+
+// Run loop functions take the core variant's policies as template parameters, Debug_Views keeps the
+// PPU's debug views drawn and Skip lets polling loops run without the CPU
+template <bool Debug_Views>
+inline void
+run_peripherals(GameBoy *gb)
+{
+    Profiler *profiler = &gb->profiler;
+
+    {
+        Profile_Scope scope(profiler, Profiler::TIMERS);
+        timers_cycle(&gb->timers, &gb->memory_bus);
+    }
+    {
+        Profile_Scope scope(profiler, Profiler::PPU);
+        ppu_cycle<Debug_Views, false>(&gb->ppu, &gb->memory_bus);
+    }
+
+    gb->memory_bus.cycles++;
+}
+
+template <bool Debug_Views>
+inline void
+run_cycle(GameBoy *gb)
+{
+    {
+        Profile_Scope scope(&gb->profiler, Profiler::CPU);
+        cpu_cycle(&gb->cpu, &gb->memory_bus);
+    }
+
+    run_peripherals<Debug_Views>(gb);
+}
+
+// Only IF bits that are also enabled make the CPU leave the loop
+inline bool
+interrupt_pending(GameBoy *gb)
+{
+    return gb->memory_bus.interrupts_pending;
+}
+
+// The first recording may start with what the code before the loop left in the registers, or exit
+// because the polled byte already holds what the loop waits for. Only a loop that fails twice in a
+// row without being skipped in between is never recorded again
+void
+idle_reject(Idle_Loop *idle)
+{
+    if (idle->unsettled == idle->start)
+    {
+        idle->rejected[idle->start % IDLE_REJECT_SLOTS] = idle->start;
+    }
+
+    idle->unsettled = idle->start;
+    idle->state = Idle_Loop::State::WATCH;
+}
+
+// Called at every instruction boundary of the recorded iteration, the iteration is complete once
+// the loop is back at its start with the state it started with
+void
+idle_record_boundary(GameBoy *gb)
+{
+    Idle_Loop *idle = &gb->idle;
+    CPU *cpu = &gb->cpu;
+
+    if (cpu->pc == idle->start && idle->length)
+    {
+        CPU *first = &idle->recording[0];
+
+        // Counting loops never come back to the state they started in
+        if (memcmp(cpu->registers, first->registers, sizeof(cpu->registers)) != 0 || cpu->sp != first->sp ||
+            cpu->w != first->w || cpu->z != first->z)
+        {
+            idle_reject(idle);
+            return;
+        }
+
+        idle->unsettled = 0xFFFF;
+        idle->state = Idle_Loop::State::SKIP;
+        idle->phase = 0;
+        return;
+    }
+
+    u16 address;
+    bool reads;
+
+    if (cpu->pc >= 0x8000 || !cpu_polling_instruction(cpu, &gb->memory_bus, &address, &reads))
+    {
+        idle_reject(idle);
+        return;
+    }
+
+    if (!reads)
+    {
+        return;
+    }
+
+    // APU reads catch the APU up, and a loop polling two bytes is not followed
+    if ((address >= APU_REGISTER_START && address <= APU_REGISTER_END) || (idle->polling && address != idle->address))
+    {
+        idle_reject(idle);
+        return;
+    }
+
+    idle->polling = true;
+    idle->address = address;
+    idle->value = gb->memory_bus.read_u8(address);
+}
+
+void
+idle_record_start(GameBoy *gb)
+{
+    Idle_Loop *idle = &gb->idle;
+
+    idle->state = Idle_Loop::State::RECORD;
+    idle->start = gb->cpu.pc;
+    idle->polling = false;
+    idle->interrupts = gb->cpu.interrupt_master_enable;
+    idle->length = 0;
+
+    idle_record_boundary(gb);
+}
+
+// Whether the loop could take another path from this cycle on
+inline bool
+idle_disturbed(GameBoy *gb)
+{
+    Idle_Loop *idle = &gb->idle;
+
+    return (idle->polling && gb->memory_bus.read_u8(idle->address) != idle->value) ||
+        (idle->interrupts && interrupt_pending(gb));
+}
+
+template <bool Debug_Views>
+void
+idle_record_cycle(GameBoy *gb)
+{
+    Idle_Loop *idle = &gb->idle;
+    CPU *cpu = &gb->cpu;
+
+    if (idle->length == IDLE_LOOP_CYCLES)
+    {
+        idle_reject(idle);
+        run_cycle<Debug_Views>(gb);
+        return;
+    }
+
+    // Not a reason to reject the loop, it is recorded again on its next iteration
+    if (idle_disturbed(gb))
+    {
+        idle->state = Idle_Loop::State::WATCH;
+        run_cycle<Debug_Views>(gb);
+        return;
+    }
+
+    idle->recording[idle->length++] = *cpu;
+    run_cycle<Debug_Views>(gb);
+    cpu->jumped_back = false;
+
+    if (cpu->state == CPU::STATE::READ_OPCODE && !cpu->extended)
+    {
+        idle_record_boundary(gb);
+    }
+}
+
+// The CPU is left in the state it has at the current cycle of the iteration
+void
+idle_settle(GameBoy *gb)
+{
+    Idle_Loop *idle = &gb->idle;
+
+    if (idle->state == Idle_Loop::State::SKIP)
+    {
+        gb->cpu = idle->recording[idle->phase];
+    }
+
+    idle->state = Idle_Loop::State::WATCH;
+}
+
+// Called after a cycle that ran the CPU, the flag costs the cycles outside a loop a single test
+inline bool
+idle_watch(GameBoy *gb)
+{
+    CPU *cpu = &gb->cpu;
+
+    if (!cpu->jumped_back)
+    {
+        return false;
+    }
+
+    cpu->jumped_back = false;
+
+    // An interrupt can be dispatched in the cycle that completes the jump
+    if (cpu->state != CPU::STATE::READ_OPCODE || cpu->pc >= 0x8000 || gb->idle.rejected[cpu->pc % IDLE_REJECT_SLOTS] == cpu->pc)
+    {
+        return false;
+    }
+
+    idle_record_start(gb);
+
+    return gb->idle.state != Idle_Loop::State::WATCH;
+}
+
+// A CPU cycle only reads the polled byte and checks for interrupts, so while neither changes every
+// iteration repeats the recorded one and the cycle can go without the CPU
+template <bool Debug_Views>
+void
+idle_skip_cycle(GameBoy *gb)
+{
+    Idle_Loop *idle = &gb->idle;
+
+    if (idle_disturbed(gb))
+    {
+        idle_settle(gb);
+        run_cycle<Debug_Views>(gb);
+        return;
+    }
+
+    run_peripherals<Debug_Views>(gb);
+
+    if (++idle->phase == idle->length)
+    {
+        idle->phase = 0;
+    }
+}
+
+// Runs the loop being recorded or skipped until the CPU leaves it, done() holds after a cycle or
+// max_cycles have passed. Returns the number of cycles run
+template <bool Debug_Views, typename Done>
+u64
+idle_run(GameBoy *gb, u64 max_cycles, Done done)
+{
+    Idle_Loop *idle = &gb->idle;
+    u64 i = 0;
+
+    while (idle->state != Idle_Loop::State::WATCH && i < max_cycles)
+    {
+        if (idle->state == Idle_Loop::State::RECORD)
+        {
+            idle_record_cycle<Debug_Views>(gb);
+        }
+        else
+        {
+            idle_skip_cycle<Debug_Views>(gb);
+        }
+
+        ++i;
+
+        if (done())
+        {
+            break;
+        }
+    }
+
+    return i;
+}
+
+template <bool Skip, bool Debug_Views>
+void
+run_cycles(GameBoy *gb, u64 cycles)
+{
+    if constexpr (!Skip)
+    {
+        for (u64 i = 0; i < cycles; ++i)
+        {
+            run_cycle<Debug_Views>(gb);
+        }
+
+        return;
+    }
+
+    for (u64 i = 0; i < cycles;)
+    {
+        run_cycle<Debug_Views>(gb);
+        ++i;
+
+        // A loop left on its last cycle may already have jumped back again
+        while (i < cycles && idle_watch(gb))
+        {
+            i += idle_run<Debug_Views>(gb, cycles - i, []() { return false; });
+        }
+    }
+}
+
+// One loop per condition type so the check compiles down to a compare against a local
+template <Run_Condition::Type type, bool Skip, bool Debug_Views>
+bool
+run_until(GameBoy *gb, Run_Condition condition, u64 max_cycles)
+{
+    CPU *cpu = &gb->cpu;
+    u8 *memory = gb->memory_bus.memory;
+
+    u8 watched = memory[condition.address];
+    u64 frame_target = gb->ppu.frame_count + condition.frames;
+
+    auto met = [=]() -> bool
+    {
+        if constexpr (type == Run_Condition::Type::PC)
+        {
+            return cpu->pc == condition.address && cpu->state == CPU::STATE::READ_OPCODE && !cpu->extended && !cpu->halted;
+        }
+        else if constexpr (type == Run_Condition::Type::LY)
+        {
+            return memory[LY_REGISTER] == condition.value;
+        }
+        else if constexpr (type == Run_Condition::Type::MEMORY_CHANGE)
+        {
+            return memory[condition.address] != watched;
+        }
+        else
+        {
+            return gb->ppu.frame_count >= frame_target;
+        }
+    };
+
+    for (u64 i = 0; i < max_cycles;)
+    {
+        run_cycle<Debug_Views>(gb);
+        ++i;
+
+        if (met())
+        {
+            return true;
+        }
+
+        if constexpr (Skip)
+        {
+            while (i < max_cycles && idle_watch(gb))
+            {
+                i += idle_run<Debug_Views>(gb, max_cycles - i, met);
+
+                if (met())
+                {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+template <bool Skip, bool Debug_Views>
+bool
+run_until_condition(GameBoy *gb, Run_Condition condition, u64 max_cycles)
+{
+    switch (condition.type)
+    {
+        // A PC condition has to see the CPU arrive at every instruction, so it never skips
+        case Run_Condition::Type::PC:
+            return run_until<Run_Condition::Type::PC, false, Debug_Views>(gb, condition, max_cycles);
+        case Run_Condition::Type::LY:
+            return run_until<Run_Condition::Type::LY, Skip, Debug_Views>(gb, condition, max_cycles);
+        case Run_Condition::Type::MEMORY_CHANGE:
+            return run_until<Run_Condition::Type::MEMORY_CHANGE, Skip, Debug_Views>(gb, condition, max_cycles);
+        case Run_Condition::Type::FRAMES:
+            return run_until<Run_Condition::Type::FRAMES, Skip, Debug_Views>(gb, condition, max_cycles);
+    }
+
+    return false;
+}
+
+// The run loop compiled for one combination of policies, so a configuration carries no tests for
+// features it leaves off. Tracing and profiling are already compiled in or out by their build flags
+struct Core_Variant
+{
+    void (*run_cycles)(GameBoy *gb, u64 cycles);
+    bool (*run_until)(GameBoy *gb, Run_Condition condition, u64 max_cycles);
+};
+
+// Indexed by idle skipping << 1 | debug views
+const Core_Variant CORE_VARIANTS[4] = {
+    {run_cycles<false, false>, run_until_condition<false, false>},
+    {run_cycles<false, true>, run_until_condition<false, true>},
+    {run_cycles<true, false>, run_until_condition<true, false>},
+    {run_cycles<true, true>, run_until_condition<true, true>},
+};
+
+// Skipped cycles would be missing from the profile
+const Core_Variant *
+select_core(GameBoy *gb)
+{
+    bool skip = gb->idle_skip && !PROFILER_ENABLED;
+    return &CORE_VARIANTS[(skip << 1) | gb->ppu.debug_views];
+}
+
+void
+gameboy_run_cycles(GameBoy *gb, u64 cycles)
+{
+    select_core(gb)->run_cycles(gb, cycles);
+    idle_settle(gb);
+}
+
+// The core lockstep compares against, kept as straightforward as the fast paths it checks: interrupts
+// are dispatched through the CPU pipeline and the PPU draws every pixel from VRAM and OAM as the line
+// starts. It never skips polling loops and draws no debug views
+void
+gameboy_run_reference_cycles(GameBoy *gb, u64 cycles)
+{
+    for (u64 i = 0; i < cycles; ++i)
+    {
+        cpu_cycle_reference(&gb->cpu, &gb->memory_bus);
+        timers_cycle(&gb->timers, &gb->memory_bus);
+        ppu_cycle<false, true>(&gb->ppu, &gb->memory_bus);
+        gb->memory_bus.cycles++;
+    }
+}
+
+// Runs until the condition holds or max_cycles have passed, returns whether the condition was met.
+// MEMORY_CHANGE watches Memory_Bus::memory so it does not see ROM or cartridge RAM
+bool
+gameboy_run_until(GameBoy *gb, Run_Condition condition, u64 max_cycles)
+{
+    bool met = select_core(gb)->run_until(gb, condition, max_cycles);
+    idle_settle(gb);
+
+    return met;
+}
+
+// Runs to the start of the next VBLANK. With the LCD off no frame completes and a frame worth of
+// cycles is run instead, false is returned in that case
+bool
+gameboy_run_frame(GameBoy *gb)
+{
+    Run_Condition condition = {};
+    condition.type = Run_Condition::Type::FRAMES;
+    condition.frames = 1;
+
+    return gameboy_run_until(gb, condition, CYCLES_PER_FRAME);
+}
+
+// Hash of the shades in the frame buffer, used to compare frames between runs, builds and cores
+u64
+gameboy_frame_hash(GameBoy *gb)
+{
+    return hash_bytes(gb->ppu.frame_buffer, sizeof(gb->ppu.frame_buffer));
+}
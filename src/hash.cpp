@@ -0,0 +1,109 @@
+#include "hash.h"
+
+#include <cstring>
+
+constexpr u64 PRIME_1 = 0x9E3779B185EBCA87ULL;
+constexpr u64 PRIME_2 = 0xC2B2AE3D27D4EB4FULL;
+constexpr u64 PRIME_3 = 0x165667B19E3779F9ULL;
+constexpr u64 PRIME_4 = 0x85EBCA77C2B2AE63ULL;
+constexpr u64 PRIME_5 = 0x27D4EB2F165667C5ULL;
+
+inline u64
+rotate_left(u64 v, u32 bits)
+{
+    return (v << bits) | (v >> (64 - bits));
+}
+
+inline u64
+read_u64(const u8 *p)
+{
+    u64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline u32
+read_u32(const u8 *p)
+{
+    u32 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline u64
+hash_round(u64 accumulator, u64 input)
+{
+    accumulator += input * PRIME_2;
+    accumulator = rotate_left(accumulator, 31);
+    return accumulator * PRIME_1;
+}
+
+inline u64
+merge_round(u64 accumulator, u64 v)
+{
+    accumulator ^= hash_round(0, v);
+    return accumulator * PRIME_1 + PRIME_4;
+}
+
+u64
+hash_bytes(const void *data, u64 size, u64 seed)
+{
+    const u8 *p = reinterpret_cast<const u8*>(data);
+    const u8 *end = p + size;
+    u64 h;
+
+    if (size >= 32)
+    {
+        u64 v1 = seed + PRIME_1 + PRIME_2;
+        u64 v2 = seed + PRIME_2;
+        u64 v3 = seed;
+        u64 v4 = seed - PRIME_1;
+
+        for (const u8 *limit = end - 32; p <= limit; p += 32)
+        {
+            v1 = hash_round(v1, read_u64(p));
+            v2 = hash_round(v2, read_u64(p + 8));
+            v3 = hash_round(v3, read_u64(p + 16));
+            v4 = hash_round(v4, read_u64(p + 24));
+        }
+
+        h = rotate_left(v1, 1) + rotate_left(v2, 7) + rotate_left(v3, 12) + rotate_left(v4, 18);
+        h = merge_round(h, v1);
+        h = merge_round(h, v2);
+        h = merge_round(h, v3);
+        h = merge_round(h, v4);
+    }
+    else
+    {
+        h = seed + PRIME_5;
+    }
+
+    h += size;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        h ^= hash_round(0, read_u64(p));
+        h = rotate_left(h, 27) * PRIME_1 + PRIME_4;
+    }
+
+    if (p + 4 <= end)
+    {
+        h ^= read_u32(p) * PRIME_1;
+        h = rotate_left(h, 23) * PRIME_2 + PRIME_3;
+        p += 4;
+    }
+
+    for (; p < end; ++p)
+    {
+        h ^= *p * PRIME_5;
+        h = rotate_left(h, 11) * PRIME_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME_2;
+    h ^= h >> 29;
+    h *= PRIME_3;
+    h ^= h >> 32;
+
+    return h;
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "types.h"
+
+// 64 bit xxHash (XXH64). Fast enough to hash the whole address space or a frame every few
+// instructions and stable across builds, so hashes can be stored and compared between runs
+u64 hash_bytes(const void *data, u64 size, u64 seed = 0);
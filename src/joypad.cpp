@@ -1,118 +1,76 @@
 #include "emulator.h"
 
-const u8 A = 0x01;
-const u8 RIGHT = 0x10;
-
-const u8 B = 0x02;
-const u8 LEFT = 0x20;
-
-const u8 SELECT = 0x04;
-const u8 UP = 0x40;
-
-const u8 START = 0x08;
-const u8 DOWN = 0x80;
-
+// P1 lines are active low, a select bit at 0 connects its group and both groups are ANDed when
+// both are selected. Bits 6 and 7 are unused and read as 1
 void
-set_joypad_state(Input_events *events, Joypad *joypad)
+update_p1_table(Joypad *joypad)
 {
-    u8 test = 0;
+    u8 directions = ~(joypad->buttons >> 4) & 0x0F;
+    u8 buttons = ~joypad->buttons & 0x0F;
 
-    if (keyboard_down(events, Input_events::KEY_CODE::RIGHT))
-    {
-        test = RIGHT;
-    }
-    else if (keyboard_up(events, Input_events::KEY_CODE::RIGHT))
-    {
-        joypad->state = 0xFF;
-    }
-    else if (keyboard_down(events, Input_events::KEY_CODE::LEFT))
+    for (u8 select = 0; select < 4; ++select)
     {
-        test = LEFT;
-    }
-    else if (keyboard_up(events, Input_events::KEY_CODE::LEFT))
-    {
-        joypad->state = 0xFF;
-    }
-    else if (keyboard_down(events, Input_events::KEY_CODE::UP))
-    {
-        test = UP;
-    }
-    else if (keyboard_up(events, Input_events::KEY_CODE::UP))
-    {
-        joypad->state = 0xFF;
-    }
-    else if (keyboard_down(events, Input_events::KEY_CODE::DOWN))
-    {
-        test = DOWN;
-    }
-    else if (keyboard_up(events, Input_events::KEY_CODE::DOWN))
-    {
-        joypad->state = 0xFF;
-    }
-    else if (keyboard_down(events, Input_events::KEY_CODE::A))
-    {
-        test = A;
-    }
-    else if (keyboard_up(events, Input_events::KEY_CODE::A))
-    {
-        joypad->state = 0xFF;
-    }
-    else if (keyboard_down(events, Input_events::KEY_CODE::B))
-    {
-        test = B;
-    }
-    else if (keyboard_up(events, Input_events::KEY_CODE::B))
-    {
-        joypad->state = 0xFF;
-    }
-    else if (keyboard_down(events, Input_events::KEY_CODE::BACK))
-    {
-        test = SELECT;
-    }
-    else if (keyboard_up(events, Input_events::KEY_CODE::BACK))
-    {
-        joypad->state = 0xFF;
-    }
-    else if (keyboard_down(events, Input_events::KEY_CODE::RETURN))
-    {
-        test = START;
-    }
-    else if (keyboard_up(events, Input_events::KEY_CODE::BACK))
-    {
-        joypad->state = 0xFF;
-    }
-
-    // Check if previously the corresponding bit was set to 1
-    u8 prev_state = joypad->state & test;
+        u8 lines = 0x0F;
 
-    if (test > 0 && prev_state)
-    {
-        if (test < RIGHT)
+        if ((select & 0x01) == 0)
         {
-            joypad->button = true;
+            lines &= directions;
         }
-        else
+
+        if ((select & 0x02) == 0)
         {
-            joypad->direction = true;
+            lines &= buttons;
         }
 
-        joypad->state = 0xFF & (~test);
+        joypad->p1[select] = 0xC0 | (select << 4) | lines;
     }
 }
 
 void
-handle_input_event(Memory_Bus *memory_bus)
+joypad_init(Joypad *joypad)
 {
-    u8 req = memory_bus->memory[JOYPAD_REGISTER];
+    joypad->buttons = 0;
+    update_p1_table(joypad);
+}
 
-    if (memory_bus->joypad.button && (req & JOYPAD_BUTTON_REQUEST) == 0)
+// The joypad interrupt is requested when any P1 input line goes from high to low, which can only
+// happen when the buttons change or when a write to P1 selects a different group
+void
+request_on_falling_edge(Memory_Bus *memory_bus, u8 previous, u8 current)
+{
+    if (previous & ~current & 0x0F)
     {
         perform_interrupt(memory_bus, INTERRUPT_JOYPAD);
-        memory_bus->joypad.button = false;
     }
-    else if (memory_bus->joypad.direction && (req & JOYPAD_DIRECTION_REQUEST) == 0)
+}
+
+// Takes the full set of held buttons
+void
+joypad_set_buttons(Memory_Bus *memory_bus, u8 buttons)
+{
+    Joypad *joypad = &memory_bus->joypad;
+
+    if (buttons == joypad->buttons)
     {
-        perform_interrupt(memory_bus, INTERRUPT_JOYPAD);
-        memory_bus->joypad.direction = false;
+        return;
     }
-}
\ No newline at end of file
+
+    u8 select = (memory_bus->memory[JOYPAD_REGISTER] >> 4) & 0x03;
+    u8 previous = joypad->p1[select];
+
+    joypad->buttons = buttons;
+    update_p1_table(joypad);
+
+    request_on_falling_edge(memory_bus, previous, joypad->p1[select]);
+}
+
+void
+joypad_write_select(Memory_Bus *memory_bus, u8 v)
+{
+    Joypad *joypad = &memory_bus->joypad;
+    u8 previous = joypad->p1[(memory_bus->memory[JOYPAD_REGISTER] >> 4) & 0x03];
+
+    memory_bus->memory[JOYPAD_REGISTER] = (v & 0x30) | 0x0F;
+
+    request_on_falling_edge(memory_bus, previous, joypad->p1[(v >> 4) & 0x03]);
+}
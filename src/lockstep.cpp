@@ -0,0 +1,234 @@
+#include "emulator.h"
+
+#include <cstdio>
+#include <cstring>
+
+const char *REGISTER_NAMES[] = {"B", "C", "D", "E", "H", "L", "F", "A"};
+
+constexpr u32 MAX_REPORTED_ADDRESSES = 8;
+
+struct Lockstep_State
+{
+    u8 registers[8];
+    u16 pc;
+    u16 sp;
+    bool interrupt_master_enable;
+    bool halted;
+    u64 memory_hash;
+    u64 frame_hash;
+};
+
+void
+capture_state(GameBoy *gb, Lockstep_State *state)
+{
+    for (u8 i = 0; i < 8; ++i)
+    {
+        state->registers[i] = gb->cpu.registers[i];
+    }
+
+    state->pc = gb->cpu.pc;
+    state->sp = gb->cpu.sp;
+    state->interrupt_master_enable = gb->cpu.interrupt_master_enable;
+    state->halted = gb->cpu.halted;
+    state->memory_hash = hash_bytes(gb->memory_bus.memory, sizeof(gb->memory_bus.memory));
+    state->frame_hash = gameboy_frame_hash(gb);
+}
+
+// Hashes only say that something differs, the diff goes back to both instances to say where
+void
+report_divergence(Lockstep *lockstep, Lockstep_State *reference, Lockstep_State *candidate)
+{
+    GameBoy *ref = lockstep->reference;
+    GameBoy *cand = lockstep->candidate;
+
+    printf("[Lockstep] Divergence after %llu instructions at cycle %llu\n",
+        static_cast<unsigned long long>(lockstep->instructions),
+        static_cast<unsigned long long>(ref->memory_bus.cycles));
+
+    for (u8 i = 0; i < 8; ++i)
+    {
+        if (reference->registers[i] != candidate->registers[i])
+        {
+            printf("    %s: %02X != %02X\n", REGISTER_NAMES[i], reference->registers[i], candidate->registers[i]);
+        }
+    }
+
+    if (reference->pc != candidate->pc)
+    {
+        printf("    PC: %04X != %04X\n", reference->pc, candidate->pc);
+    }
+
+    if (reference->sp != candidate->sp)
+    {
+        printf("    SP: %04X != %04X\n", reference->sp, candidate->sp);
+    }
+
+    if (reference->interrupt_master_enable != candidate->interrupt_master_enable)
+    {
+        printf("    IME: %u != %u\n", reference->interrupt_master_enable, candidate->interrupt_master_enable);
+    }
+
+    if (reference->halted != candidate->halted)
+    {
+        printf("    HALTED: %u != %u\n", reference->halted, candidate->halted);
+    }
+
+    if (reference->memory_hash != candidate->memory_hash)
+    {
+        u32 differences = 0;
+
+        for (u32 address = 0; address <= 0xFFFF; ++address)
+        {
+            u8 a = ref->memory_bus.memory[address];
+            u8 b = cand->memory_bus.memory[address];
+
+            if (a != b && differences++ < MAX_REPORTED_ADDRESSES)
+            {
+                printf("    [%04X]: %02X != %02X\n", address, a, b);
+            }
+        }
+
+        printf("    memory: %u bytes differ\n", differences);
+    }
+
+    if (reference->frame_hash != candidate->frame_hash)
+    {
+        u32 differences = 0;
+        u32 first = 0;
+
+        for (u32 i = 0; i < GAMEBOY_WIDTH * GAMEBOY_HEIGHT; ++i)
+        {
+            if (ref->ppu.frame_buffer[i] != cand->ppu.frame_buffer[i] && differences++ == 0)
+            {
+                first = i;
+            }
+        }
+
+        printf("    frame_buffer: %u pixels differ, first at (%u, %u)\n", differences, first % GAMEBOY_WIDTH, first / GAMEBOY_WIDTH);
+    }
+}
+
+bool
+compare(Lockstep *lockstep)
+{
+    Lockstep_State reference;
+    Lockstep_State candidate;
+
+    capture_state(lockstep->reference, &reference);
+    capture_state(lockstep->candidate, &candidate);
+
+    lockstep->comparisons++;
+
+    if (memcmp(&reference.registers, &candidate.registers, sizeof(reference.registers)) == 0 &&
+        reference.pc == candidate.pc &&
+        reference.sp == candidate.sp &&
+        reference.interrupt_master_enable == candidate.interrupt_master_enable &&
+        reference.halted == candidate.halted &&
+        reference.memory_hash == candidate.memory_hash &&
+        reference.frame_hash == candidate.frame_hash)
+    {
+        return true;
+    }
+
+    report_divergence(lockstep, &reference, &candidate);
+    return false;
+}
+
+// One cycle at a time through the reference core until the next opcode fetch. A halted CPU counts
+// every cycle as an instruction so the comparison interval still advances
+void
+step_instruction(GameBoy *gb)
+{
+    do
+    {
+        gameboy_run_reference_cycles(gb, 1);
+    } while (gb->cpu.state != CPU::STATE::READ_OPCODE || gb->cpu.extended);
+}
+
+void
+sync_candidate(Lockstep *lockstep)
+{
+    u64 target = lockstep->reference->memory_bus.cycles;
+    u64 current = lockstep->candidate->memory_bus.cycles;
+
+    if (target > current)
+    {
+        lockstep->candidate_run(lockstep->candidate, target - current);
+    }
+}
+
+// The candidate must have just been initialised, the reference starts from the same power on state
+Lockstep *
+lockstep_create(GameBoy *candidate, Run_Cycles_Function candidate_run, u64 interval)
+{
+    Cartridge *cartridge = &candidate->memory_bus.cartridge;
+
+    GameBoy *reference = new GameBoy();
+    reference->memory_bus.cartridge.path = cartridge->path;
+
+    if (!cartridge_load(&reference->memory_bus.cartridge, cartridge->data, cartridge->size))
+    {
+        delete reference;
+        return NULL;
+    }
+
+    gameboy_init(reference);
+
+    Lockstep *lockstep = new Lockstep();
+    lockstep->reference = reference;
+    lockstep->candidate = candidate;
+    lockstep->candidate_run = candidate_run;
+    lockstep->interval = interval ? interval : 1;
+    lockstep->instructions = 0;
+    lockstep->comparisons = 0;
+    lockstep->diverged = false;
+
+    printf("[Lockstep] Comparing against the reference core every %llu instructions\n", static_cast<unsigned long long>(lockstep->interval));
+
+    return lockstep;
+}
+
+void
+lockstep_destroy(Lockstep *lockstep)
+{
+    printf("[Lockstep] %llu instructions, %llu comparisons%s\n",
+        static_cast<unsigned long long>(lockstep->instructions),
+        static_cast<unsigned long long>(lockstep->comparisons),
+        lockstep->diverged ? ", diverged" : "");
+
+    delete lockstep->reference;
+    delete lockstep;
+}
+
+// Advances both cores by at least cycles, returns false and stops at the first divergence
+bool
+lockstep_run_cycles(Lockstep *lockstep, u64 cycles)
+{
+    if (lockstep->diverged)
+    {
+        return false;
+    }
+
+    GameBoy *reference = lockstep->reference;
+    u64 target = lockstep->candidate->memory_bus.cycles + cycles;
+
+    while (reference->memory_bus.cycles < target)
+    {
+        step_instruction(reference);
+
+        if (++lockstep->instructions % lockstep->interval == 0)
+        {
+            sync_candidate(lockstep);
+
+            if (!compare(lockstep))
+            {
+                lockstep->diverged = true;
+                return false;
+            }
+        }
+    }
+
+    sync_candidate(lockstep);
+
+    return true;
+}
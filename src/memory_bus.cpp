@@ -6,63 +6,67 @@ dma_transfer(Memory_Bus *memory_bus, u16 address)
 {
     for (u8 i = 0; i < 0xA0; ++i)
     {
-        memory_bus->write_i8(0xFE00+i, memory_bus->read_u8(address + i));
+        memory_bus->memory[OAM_START_ADDRESS + i] = memory_bus->read_u8(address + i);
+        ppu_write_oam(memory_bus->ppu, memory_bus, OAM_START_ADDRESS + i);
     }
 }
 
+// Instantiated once per mapper so a write only tests what its controller decodes
+template <Mapper mapper>
 void
-handle_banking(Cartridge *cartridge, u16 address, u8 v)
+handle_banking(Memory_Bus *memory_bus, u16 address, u8 v)
 {
+    Cartridge *cartridge = &memory_bus->cartridge;
+
+    if constexpr (mapper == Mapper::ROM_ONLY)
+    {
+        return;
+    }
+
     if (address < 0x2000)
     {
-        if (cartridge->mbc1 || cartridge->mbc2)
+        if (mapper == Mapper::MBC2 && ((address >> 4) & 0x01) == 1)
         {
-            if (cartridge->mbc2 && ((address >> 4) & 0x01) == 1)
-            {
-                return;
-            }
+            return;
+        }
 
-            u8 test = v & 0x0F;
+        u8 test = v & 0x0F;
 
-            if (test == 0x0A)
-            {
-                cartridge->ram_bank_enabled = true;
-            }
-            else
-            {
-                cartridge->ram_bank_enabled = false;
-            }
-
-            printf("[Cartridge] RAM bank changed to: %d\n", cartridge->current_ram_bank);
+        if (test == 0x0A)
+        {
+            cartridge->ram_bank_enabled = true;
+        }
+        else
+        {
+            cartridge->ram_bank_enabled = false;
         }
+
+        trace_event(memory_bus->trace, Trace_Level::DEBUG, Trace_Event::RAM_ENABLE, memory_bus->cycles, cartridge->ram_bank_enabled);
     }
     else if (address >= 0x2000 && address < 0x4000)
     {
-        if (cartridge->mbc1 || cartridge->mbc2)
+        if constexpr (mapper == Mapper::MBC2)
         {
-            if (cartridge->mbc2)
-            {
-                cartridge->current_rom_bank = v & 0x0F;
-            }
-            else
-            {
-                u8 lower_5 = v & 0x1F;
-                cartridge->current_rom_bank &= 0xE0;
-                cartridge->current_rom_bank |= lower_5;
-            }
-
-            if (cartridge->current_rom_bank == 0)
-            {
-                cartridge->current_rom_bank++;
-            }
+            cartridge->current_rom_bank = v & 0x0F;
+        }
+        else
+        {
+            u8 lower_5 = v & 0x1F;
+            cartridge->current_rom_bank &= 0xE0;
+            cartridge->current_rom_bank |= lower_5;
+        }
 
-            printf("[Cartridge] ROM bank changed to: %d\n", cartridge->current_rom_bank);
+        if (cartridge->current_rom_bank == 0)
+        {
+            cartridge->current_rom_bank++;
         }
+
+        trace_event(memory_bus->trace, Trace_Level::DEBUG, Trace_Event::ROM_BANK, memory_bus->cycles, cartridge->current_rom_bank);
     }
     else if (address >= 0x4000 && address < 0x6000)
     {
         // NOTE: MBC2 has no ram bank
-        if (cartridge->mbc1)
+        if constexpr (mapper == Mapper::MBC1)
         {
             if (cartridge->rom_bank_enabled)
             {
@@ -74,18 +78,18 @@ handle_banking(Cartridge *cartridge, u16 address, u8 v)
                     cartridge->current_rom_bank++;
                 }
 
-                printf("[Cartridge] ROM bank changed to: %d\n", cartridge->current_rom_bank);
+                trace_event(memory_bus->trace, Trace_Level::DEBUG, Trace_Event::ROM_BANK, memory_bus->cycles, cartridge->current_rom_bank);
             }
             else
             {
                 cartridge->current_ram_bank = v & 0x03;
-                printf("[Cartridge] RAM bank changed to: %d\n", cartridge->current_ram_bank);
+                trace_event(memory_bus->trace, Trace_Level::DEBUG, Trace_Event::RAM_BANK, memory_bus->cycles, cartridge->current_ram_bank);
             }
         }
     }
     else if (address >= 0x6000 && address < 0x8000)
     {
-        if (cartridge->mbc1)
+        if constexpr (mapper == Mapper::MBC1)
         {
             u8 data = v & 0x01;
             cartridge->rom_bank_enabled = (data == 0) ? true : false;
@@ -98,15 +102,23 @@ handle_banking(Cartridge *cartridge, u16 address, u8 v)
     }
 }
 
+// Indexed by Mapper
+void (*const BANKING_HANDLERS[])(Memory_Bus *memory_bus, u16 address, u8 v) = {
+    handle_banking<Mapper::ROM_ONLY>,
+    handle_banking<Mapper::MBC1>,
+    handle_banking<Mapper::MBC2>,
+};
+
 void 
 Memory_Bus::write_u8(u16 address, u8 v) 
 {
     if (address < 0x8000)
     {
-        handle_banking(&cartridge, address, v);
+        handle_banking(this, address, v);
     }
     else if (address < 0xA000) // VRAM (switchable bank 0-1 in CGB Mode)
     {
+        ppu_write_vram(ppu, this, address, v);
         memory[address] = v;
     }
     else if (address < 0xC000)
@@ -126,6 +138,11 @@ Memory_Bus::write_u8(u16 address, u8 v)
         memory[address] = v;
         write_u8(address - 0x2000, v);
     }
+    else if (address >= OAM_START_ADDRESS && address <= OAM_END_ADDRESS)
+    {
+        memory[address] = v;
+        ppu_write_oam(ppu, this, address);
+    }
     else if(address >= 0xFEA0 && address <= 0xFEFF) // Not usable
     {
         // printf("[Memory bus] write to unusable area\n");
@@ -139,9 +156,21 @@ Memory_Bus::write_u8(u16 address, u8 v)
         memory[address] = v;
         timers_set_tac(timers, v);
     }
+    else if (address == LCD_STATUS_REGISTER)
+    {
+        // The mode and LY == LYC bits are read only and bit 7 always reads 1
+        memory[address] = 0x80 | (v & 0x78) | (memory[address] & 0x07);
+        ppu_update_stat(ppu, this);
+    }
     else if (address == LY_REGISTER)
     {
         memory[address] = 0;
+        ppu_update_stat(ppu, this);
+    }
+    else if (address == LYC_REGISTER)
+    {
+        memory[address] = v;
+        ppu_update_stat(ppu, this);
     }
     else if (address == DMA_REGISTER)
     {
@@ -149,11 +178,20 @@ Memory_Bus::write_u8(u16 address, u8 v)
     }
     else if (address == JOYPAD_REGISTER)
     {
-        memory[address] = (v & 0x30) | 0x0F;
+        joypad_write_select(this, v);
     }
     else if (address == SERIAL_DATA_TRANSFER)
     {
     }
+    else if (address >= APU_REGISTER_START && address <= APU_REGISTER_END)
+    {
+        apu_write(apu, address, v, cycles);
+    }
+    else if (address == INTERRUPT_FLAG || address == INTERRUPT_ENABLE)
+    {
+        memory[address] = v;
+        memory_bus_update_interrupts(this);
+    }
     else
     {
         memory[address] = v;
@@ -179,20 +217,11 @@ Memory_Bus::read_u8(u16 address)
     }
     else if (address == JOYPAD_REGISTER)
     {
-        u8 req = memory[address];
-
-        if ((req & JOYPAD_DIRECTION_REQUEST) == 0)
-        {
-            return (memory[address] & 0xF0) | ((joypad.state >> 4) & 0x0F);
-        }
-        else if ((req & JOYPAD_BUTTON_REQUEST) == 0)
-        {
-            return (memory[address] & 0xF0) | (joypad.state & 0x0F);
-        }
-        else
-        {
-            return memory[address];    
-        }
+        return joypad.p1[(memory[address] >> 4) & 0x03];
+    }
+    else if (address >= APU_REGISTER_START && address <= APU_REGISTER_END)
+    {
+        return apu_read(apu, address, cycles);
     }
 
     return memory[address];
@@ -224,11 +253,23 @@ Memory_Bus::read_u16(u16 address)
 }
 
 void
-memory_bus_init(Memory_Bus *memory_bus, Timers *timers)
+memory_bus_init(Memory_Bus *memory_bus, Timers *timers, PPU *ppu, APU *apu, Profiler *profiler, Trace *trace)
 {
     memory_bus->timers = timers;
+    memory_bus->ppu = ppu;
+    memory_bus->apu = apu;
+    memory_bus->profiler = profiler;
+    memory_bus->trace = trace;
+    memory_bus->cycles = 0;
+    memory_bus->handle_banking = BANKING_HANDLERS[static_cast<u8>(memory_bus->cartridge.mapper)];
     memory_bus->memory[JOYPAD_REGISTER] = 0x3F;
-    memory_bus->joypad.state = 0xFF;
-    memory_bus->joypad.button = false;
-    memory_bus->joypad.direction = false;
+    memory_bus_update_interrupts(memory_bus);
+    joypad_init(&memory_bus->joypad);
+}
+
+// Called by every write to IF or IE, and after anything that stores them directly in memory
+void
+memory_bus_update_interrupts(Memory_Bus *memory_bus)
+{
+    memory_bus->interrupts_pending = memory_bus->memory[INTERRUPT_FLAG] & memory_bus->memory[INTERRUPT_ENABLE] & 0x1F;
 }
\ No newline at end of file
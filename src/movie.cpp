@@ -0,0 +1,285 @@
+#include "emulator.h"
+
+#include <cstdio>
+#include <cstring>
+
+const char MOVIE_MAGIC[4] = {'G', 'B', 'M', 'V'};
+constexpr u32 MOVIE_VERSION = 3;
+
+// Little endian: type, cycle, then the button mask or the frame hash
+bool
+write_movie(Movie *movie)
+{
+    FILE *file = fopen(movie->path, "wb");
+
+    if (!file)
+    {
+        printf("[Movie] Unable to write %s\n", movie->path);
+        return false;
+    }
+
+    u32 count = static_cast<u32>(movie->events.size());
+
+    fwrite(MOVIE_MAGIC, sizeof(MOVIE_MAGIC), 1, file);
+    fwrite(&MOVIE_VERSION, sizeof(MOVIE_VERSION), 1, file);
+    fwrite(&movie->rom_hash, sizeof(movie->rom_hash), 1, file);
+    fwrite(&count, sizeof(count), 1, file);
+
+    for (Movie_Event &event : movie->events)
+    {
+        fwrite(&event.type, sizeof(event.type), 1, file);
+        fwrite(&event.cycle, sizeof(event.cycle), 1, file);
+
+        if (event.type == Movie_Event::Type::INPUT)
+        {
+            fwrite(&event.buttons, sizeof(event.buttons), 1, file);
+        }
+        else
+        {
+            fwrite(&event.frame_hash, sizeof(event.frame_hash), 1, file);
+        }
+    }
+
+    fclose(file);
+
+    printf("[Movie] Wrote %u events to: %s\n", count, movie->path);
+
+    return true;
+}
+
+bool
+read_movie(Movie *movie)
+{
+    FILE *file = fopen(movie->path, "rb");
+
+    if (!file)
+    {
+        printf("[Movie] Unable to open %s\n", movie->path);
+        return false;
+    }
+
+    char magic[4];
+    u32 version = 0;
+    u32 count = 0;
+
+    bool valid = fread(magic, sizeof(magic), 1, file) == 1 &&
+        memcmp(magic, MOVIE_MAGIC, sizeof(magic)) == 0 &&
+        fread(&version, sizeof(version), 1, file) == 1 &&
+        version == MOVIE_VERSION &&
+        fread(&movie->rom_hash, sizeof(movie->rom_hash), 1, file) == 1 &&
+        fread(&count, sizeof(count), 1, file) == 1;
+
+    movie->events.clear();
+
+    for (u32 i = 0; valid && i < count; ++i)
+    {
+        Movie_Event event = {};
+
+        valid = fread(&event.type, sizeof(event.type), 1, file) == 1 &&
+            event.type <= Movie_Event::Type::END &&
+            fread(&event.cycle, sizeof(event.cycle), 1, file) == 1;
+
+        if (valid && event.type == Movie_Event::Type::INPUT)
+        {
+            valid = fread(&event.buttons, sizeof(event.buttons), 1, file) == 1;
+        }
+        else if (valid)
+        {
+            valid = fread(&event.frame_hash, sizeof(event.frame_hash), 1, file) == 1;
+        }
+
+        movie->events.push_back(event);
+    }
+
+    fclose(file);
+
+    if (!valid)
+    {
+        printf("[Movie] %s is not a valid movie file\n", movie->path);
+    }
+
+    return valid;
+}
+
+void
+check_frame_hash(Movie *movie, GameBoy *gb, Movie_Event *event)
+{
+    u64 hash = gameboy_frame_hash(gb);
+
+    if (hash == event->frame_hash)
+    {
+        movie->checkpoints_matched++;
+        return;
+    }
+
+    movie->checkpoints_failed++;
+
+    printf("[Movie] Frame hash mismatch at cycle %llu: %016llx != %016llx\n",
+        static_cast<unsigned long long>(event->cycle),
+        static_cast<unsigned long long>(event->frame_hash),
+        static_cast<unsigned long long>(hash));
+}
+
+void
+print_replay_summary(Movie *movie)
+{
+    printf("[Movie] Replay %s: %u checkpoints matched, %u mismatched\n",
+        movie->checkpoints_failed ? "diverged" : "matched",
+        movie->checkpoints_matched,
+        movie->checkpoints_failed);
+}
+
+// Applies every event due at the current cycle. Reaching the end hands input back to the keyboard
+void
+apply_events(Movie *movie, GameBoy *gb)
+{
+    while (movie->mode == Movie::Mode::PLAY && movie->position < movie->events.size())
+    {
+        Movie_Event *event = &movie->events[movie->position];
+
+        if (event->cycle > gb->memory_bus.cycles)
+        {
+            return;
+        }
+
+        movie->position++;
+
+        switch (event->type)
+        {
+            case Movie_Event::Type::INPUT:
+                joypad_set_buttons(&gb->memory_bus, event->buttons);
+                break;
+            case Movie_Event::Type::CHECKPOINT:
+                check_frame_hash(movie, gb, event);
+                break;
+            case Movie_Event::Type::END:
+                check_frame_hash(movie, gb, event);
+                print_replay_summary(movie);
+                movie->mode = Movie::Mode::NONE;
+                break;
+        }
+    }
+}
+
+bool
+movie_record(Movie *movie, char *path, Cartridge *cartridge)
+{
+    movie->mode = Movie::Mode::RECORD;
+    movie->path = path;
+    movie->rom_hash = hash_bytes(cartridge->data, cartridge->size);
+    movie->events.clear();
+    movie->position = 0;
+    movie->next_checkpoint = DMG_CLOCK_RATE;
+
+    printf("[Movie] Recording input to: %s\n", path);
+
+    return true;
+}
+
+bool
+movie_play(Movie *movie, char *path, Cartridge *cartridge)
+{
+    movie->path = path;
+
+    if (!read_movie(movie))
+    {
+        movie->mode = Movie::Mode::NONE;
+        return false;
+    }
+
+    if (movie->rom_hash != hash_bytes(cartridge->data, cartridge->size))
+    {
+        printf("[Movie] %s was recorded with a different ROM, replay will not match\n", path);
+    }
+
+    movie->mode = Movie::Mode::PLAY;
+    movie->position = 0;
+    movie->checkpoints_matched = 0;
+    movie->checkpoints_failed = 0;
+
+    printf("[Movie] Playing %u events from: %s\n", static_cast<u32>(movie->events.size()), path);
+
+    return true;
+}
+
+// Called with the new button mask whenever the host input changes
+void
+movie_record_input(Movie *movie, u8 buttons, u64 cycle)
+{
+    if (movie->mode != Movie::Mode::RECORD)
+    {
+        return;
+    }
+
+    Movie_Event event = {};
+    event.type = Movie_Event::Type::INPUT;
+    event.cycle = cycle;
+    event.buttons = buttons;
+
+    movie->events.push_back(event);
+}
+
+// Splits the batch at every input change and checkpoint so events land on the exact cycle they were recorded at
+void
+movie_run_cycles(Movie *movie, GameBoy *gb, u64 cycles)
+{
+    u64 target = gb->memory_bus.cycles + cycles;
+
+    for (;;)
+    {
+        apply_events(movie, gb);
+
+        u64 now = gb->memory_bus.cycles;
+
+        if (now >= target)
+        {
+            break;
+        }
+
+        u64 next = target;
+
+        if (movie->mode == Movie::Mode::RECORD && movie->next_checkpoint < next)
+        {
+            next = movie->next_checkpoint;
+        }
+        else if (movie->mode == Movie::Mode::PLAY && movie->position < movie->events.size() && movie->events[movie->position].cycle < next)
+        {
+            next = movie->events[movie->position].cycle;
+        }
+
+        gameboy_run_cycles(gb, next - now);
+
+        if (movie->mode == Movie::Mode::RECORD && gb->memory_bus.cycles == movie->next_checkpoint)
+        {
+            Movie_Event event = {};
+            event.type = Movie_Event::Type::CHECKPOINT;
+            event.cycle = movie->next_checkpoint;
+            event.frame_hash = gameboy_frame_hash(gb);
+
+            movie->events.push_back(event);
+            movie->next_checkpoint += DMG_CLOCK_RATE;
+        }
+    }
+}
+
+void
+movie_close(Movie *movie, GameBoy *gb)
+{
+    if (movie->mode == Movie::Mode::RECORD)
+    {
+        Movie_Event event = {};
+        event.type = Movie_Event::Type::END;
+        event.cycle = gb->memory_bus.cycles;
+        event.frame_hash = gameboy_frame_hash(gb);
+
+        movie->events.push_back(event);
+        write_movie(movie);
+    }
+    else if (movie->mode == Movie::Mode::PLAY)
+    {
+        printf("[Movie] Stopped before the end of the movie\n");
+        print_replay_summary(movie);
+    }
+
+    movie->mode = Movie::Mode::NONE;
+}
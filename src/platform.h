@@ -42,6 +42,7 @@ bool init_application(int argc, char **argv, App *app);
 void update_application(App *app, i64 delta_time);
 void handle_input(App *app, Input_events *input_events);
 void render_application(App *app, u32 *pixels, int width, int height);
+void shutdown_application(App *app);
 
 // Generic OS utility
 Window * create_window(u32 height, u32 width, char *title);
@@ -3,6 +3,11 @@
 #include <cstring>
 #include <cstdio>
 
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PPU_SSE2
+#endif
+
 constexpr u16 OAM_CYCLES = 20 * 4;
 constexpr u16 PIXEL_TRANSFER_CYCLES = 43 * 4;
 constexpr u16 HBLANK_CYCLES = 51 * 4;
@@ -19,24 +24,16 @@ constexpr u8 LCD_STATUS_MODE_1_INT_SELECT = 0x10;
 constexpr u8 LCD_STATUS_MODE_2_INT_SELECT = 0x20;
 constexpr u8 LCD_STATUS_LYC_INT_SELECT = 0x40;
 
-constexpr u16 LCD_CONTROL_REGISTER = 0xFF40;
-constexpr u16 LCD_STATUS_REGISTER = 0xFF41;
-
 // Backgroyund viewport Y/X position
 constexpr u16 SCY_REGISTER = 0xFF42;
 constexpr u16 SCX_REGISTER = 0xFF43;
 
-constexpr u16 LYC_REGISTER = 0xFF45;
-
 // Window Y/(X - 7) position
 constexpr u16 WY_REGISTER = 0xFF4A;
 constexpr u16 WX_REGISTER = 0xFF4B;
 
 constexpr u16 VRAM_OBJ_DATA = 0x8000;
 
-constexpr u16 OAM_START_ADDRESS = 0xFE00;
-constexpr u16 SPRITE_DATA_START_ADDR = 0x8000;
-
 // Every two bits map to a colour. Bit mapping:
 // 0 - 1 -> id 00
 // 2 - 3 -> id 01
@@ -45,9 +42,7 @@ constexpr u16 SPRITE_DATA_START_ADDR = 0x8000;
 constexpr u16 BG_COLOUR_PALETTE_ADDRESS = 0xFF47;
 constexpr u16 SPRITE_COLOUR_PALETTE_ADDRESS[] = {0xFF48, 0xFF49};
 
-constexpr u32 PALETTE_COLOURS[] = {0x00FFFFFF, 0x00FFAAAA, 0x00FF5555, 0x00000000};
-
-constexpr u8 SPRITE_COUNT = 40;
+constexpr u16 VRAM_MAP_OFFSET = VRAM_TILE_MAP_ADDRESS - VRAM_TILE_DATA_ADDRESS;
 
 enum PALLETE_COLOUR
 {
@@ -57,11 +52,9 @@ enum PALLETE_COLOUR
     BLACK,
 };
 
-u32
-determine_colour(Memory_Bus *memory_bus, u8 num, u16 address)
+u8
+determine_colour(u8 palette, u8 num)
 {
-    u8 palette = memory_bus->read_u8(address);
-
     u8 hi, lo;
 
     switch(num)
@@ -79,6 +72,7 @@ determine_colour(Memory_Bus *memory_bus, u8 num, u16 address)
             lo = 4;
             break;
         case BLACK:
+        default:
             hi = 7;
             lo = 6;
             break;
@@ -86,37 +80,37 @@ determine_colour(Memory_Bus *memory_bus, u8 num, u16 address)
 
     u8 colour = (((palette >> hi) & 0x01) <<  1) | ((palette >> lo) & 0x01);
 
-    return PALETTE_COLOURS[colour];
+    return colour;
 }
 
 bool
-bg_and_window_enabled(Memory_Bus *memory_bus)
+bg_and_window_enabled(u8 lcdc)
 {
-    return memory_bus->read_u8(LCD_CONTROL_REGISTER) & 0x01;
+    return lcdc & 0x01;
 }
 
 bool
-obj_enabled(Memory_Bus *memory_bus)
+obj_enabled(u8 lcdc)
 {
-    return memory_bus->read_u8(LCD_CONTROL_REGISTER) & 0x02;
+    return lcdc & 0x02;
 }
 
 u8
-obj_height(Memory_Bus *memory_bus) // Width is always 8
+obj_height(u8 lcdc) // Width is always 8
 {
-    return memory_bus->read_u8(LCD_CONTROL_REGISTER) & 0x04 ? 16 : 8;
+    return lcdc & 0x04 ? 16 : 8;
 }
 
 u16
-bg_tile_map_start_address(Memory_Bus *memory_bus)
+bg_tile_map_start_address(u8 lcdc)
 {
-    return memory_bus->read_u8(LCD_CONTROL_REGISTER) & 0x08 ? 0x9C00 : 0x9800;
+    return lcdc & 0x08 ? 0x9C00 : 0x9800;
 }
 
 u16 
-bg_window_tile_data_start_address(Memory_Bus *memory_bus, bool *signed_identifiers)
+bg_window_tile_data_start_address(u8 lcdc, bool *signed_identifiers)
 {
-    if (memory_bus->read_u8(LCD_CONTROL_REGISTER) & 0x10)
+    if (lcdc & 0x10)
     {
         *signed_identifiers = false;
         return 0x8000;
@@ -129,25 +123,27 @@ bg_window_tile_data_start_address(Memory_Bus *memory_bus, bool *signed_identifie
 }
 
 bool 
-window_enabled(Memory_Bus *memory_bus)
+window_enabled(u8 lcdc)
 {
-    return memory_bus->read_u8(LCD_CONTROL_REGISTER) & 0x20;
+    return lcdc & 0x20;
 }
 
 u16 
-window_tile_map_start_address(Memory_Bus *memory_bus)
+window_tile_map_start_address(u8 lcdc)
 {
-    return memory_bus->read_u8(LCD_CONTROL_REGISTER) & 0x40 ? 0x9C00 : 0x9800;
+    return lcdc & 0x40 ? 0x9C00 : 0x9800;
 }
 
+// Checked every cycle, LCDC has no read side effects so the bus is bypassed
 bool
 lcd_ppu_enabled(Memory_Bus *memory_bus)
 {
-    return memory_bus->read_u8(LCD_CONTROL_REGISTER) & 0x80;
+    return memory_bus->memory[LCD_CONTROL_REGISTER] & 0x80;
 }
 
+// All 384 tiles of pattern data, only drawn for the debug views
 void 
-draw_vram_tiles(PPU *ppu, Memory_Bus *memory_bus)
+ppu_draw_tiles(PPU *ppu, Memory_Bus *memory_bus)
 {
     u16 start_address = VRAM_OBJ_DATA;
 
@@ -169,7 +165,7 @@ draw_vram_tiles(PPU *ppu, Memory_Bus *memory_bus)
                     u8 lo = (lo_byte >> bit) & 0x01;
                     u8 index = (hi << 1) | lo;
 
-                    ppu->tile_buffer[(col * 8) + bit + stride] = PALETTE_COLOURS[index];
+                    ppu->tile_buffer[(col * 8) + bit + stride] = index;
                 }
             }
 
@@ -178,148 +174,363 @@ draw_vram_tiles(PPU *ppu, Memory_Bus *memory_bus)
     }
 }
 
+// Colour ids 0 - 3 to shades through the BGP register
 void
-set_lcd_status_ppu_mode(Memory_Bus *memory_bus, u8 mode, u8 lcd_status)
+bg_palette_shades(u8 palette, u8 *shades)
 {
-    if ((lcd_status & 0x03) == mode)
+    for (u8 id = 0; id < 4; ++id)
     {
-        return;
+        shades[id] = (palette >> (id * 2)) & 0x03;
     }
+}
 
-    lcd_status &= 252;
-    lcd_status |= mode;
-    memory_bus->write_u8(LCD_STATUS_REGISTER, lcd_status);
+// Redraws the cells in one row of a map cache whose map entry or tile data changed since they were
+// drawn. vram points at 0x8000, either the bus memory or the render thread's copy
+void
+refresh_map_row(PPU *ppu, u8 *vram, u8 map, u8 tile_row, bool signed_identifiers)
+{
+    u8 *identifiers = vram + VRAM_MAP_OFFSET + map * 0x400 + tile_row * 32;
 
-    switch (mode)
+    for (u8 tile_column = 0; tile_column < 32; ++tile_column)
     {
-        case LCD_STATUS_PPU_MODE_0:
-            if (lcd_status & 0x08)
-            {
-                perform_interrupt(memory_bus, INTERRUPT_LCD);
-            }
-            break;
-        case LCD_STATUS_PPU_MODE_1:
-            if (lcd_status & 0x10)
-            {
-                perform_interrupt(memory_bus, INTERRUPT_LCD);
-            }
-            break;
-        case LCD_STATUS_PPU_MODE_2:
-            if (lcd_status & 0x20)
+        u16 cell = tile_row * 32 + tile_column;
+
+        // Signed identifiers address tiles relative to 0x9000
+        u16 tile = signed_identifiers ? 256 + static_cast<i8>(identifiers[tile_column]) : identifiers[tile_column];
+
+        if (ppu->map_cell_tile[map][cell] == tile && ppu->map_cell_version[map][cell] == ppu->tile_version[tile])
+        {
+            continue;
+        }
+
+        ppu->map_cell_tile[map][cell] = tile;
+        ppu->map_cell_version[map][cell] = ppu->tile_version[tile];
+
+        u8 *data = vram + tile * 16;
+        u8 *out = ppu->map_cache[map] + (tile_row * 8) * BACKGROUND_WINDOW_WIDTH + tile_column * 8;
+
+        for (u8 y = 0; y < 8; ++y)
+        {
+            u8 lo = data[y * 2];
+            u8 hi = data[y * 2 + 1];
+
+            for (u8 x = 0; x < 8; ++x)
             {
-                perform_interrupt(memory_bus, INTERRUPT_LCD);
+                out[y * BACKGROUND_WINDOW_WIDTH + x] = (((hi >> (7 - x)) & 0x01) << 1) | ((lo >> (7 - x)) & 0x01);
             }
-            break;
+        }
     }
 }
 
-u32 
-calculate_bg_pixel(PPU *ppu, Memory_Bus *memory_bus, u8 current_line)
+// The whole 256x256 background map with the current tile data and palette. Only drawn on request
+void
+ppu_draw_background(PPU *ppu, Memory_Bus *memory_bus)
 {
-    u8 scroll_x = memory_bus->read_u8(SCX_REGISTER);
-    u8 scroll_y = memory_bus->read_u8(SCY_REGISTER);
-    u8 window_x = memory_bus->read_u8(WX_REGISTER) - 7;
-    u8 window_y = memory_bus->read_u8(WY_REGISTER);
+    ppu_render_sync(ppu);
 
-    bool tile_data_signed_id;
-    u16 tile_data_start_addr = bg_window_tile_data_start_address(memory_bus, &tile_data_signed_id);
+    u8 lcdc = memory_bus->memory[LCD_CONTROL_REGISTER];
 
-    u16 bg_data_start_addr = bg_tile_map_start_address(memory_bus);
-    u8 pos_x = ppu->pixel + scroll_x; // x co-ordinate on the bg tile map
-    u8 pos_y = current_line + scroll_y; // y co-ordinate on the bg tile map
+    bool signed_identifiers;
+    bg_window_tile_data_start_address(lcdc, &signed_identifiers);
+    u8 map = bg_tile_map_start_address(lcdc) == VRAM_TILE_MAP_ADDRESS ? 0 : 1;
 
-    if (window_enabled(memory_bus))
+    for (u8 tile_row = 0; tile_row < 32; ++tile_row)
     {
-        if ((window_y <= current_line) && (ppu->pixel >= window_x))
-        {
-            bg_data_start_addr = window_tile_map_start_address(memory_bus);
-            pos_x = ppu->pixel - window_x; // x co-ordinate on the window tile map
-            pos_y = ppu->window_line_counter; // y co-ordinate on the window tile map
-            ppu->window_used = true;
-        }
+        refresh_map_row(ppu, memory_bus->memory + VRAM_TILE_DATA_ADDRESS, map, tile_row, signed_identifiers);
     }
 
-    u16 tile_column = pos_x / 8;
-    u16 tile_row = (pos_y / 8) * 32;
+    u8 shades[4];
+    bg_palette_shades(memory_bus->memory[BG_COLOUR_PALETTE_ADDRESS], shades);
 
-    u16 tile_address = bg_data_start_addr + tile_row + tile_column; // which of the 32 horizontal tiles are we on
+    for (u32 i = 0; i < sizeof(ppu->background_buffer); ++i)
+    {
+        ppu->background_buffer[i] = shades[ppu->map_cache[map][i]];
+    }
+}
+
+void
+decode_oam_entry(PPU *ppu, u8 *oam, u8 sprite)
+{
+    u8 *entry = oam + sprite * 4;
+    PPU::OAM_Entry *object = &ppu->oam_object[sprite];
 
-    u16 tile_data_addr;
-    u16 tile_id;
+    object->y_pos = entry[0] - 16;
+    object->x_pos = entry[1] - 8;
+    object->tile = entry[2];
+    object->properties.byte = entry[3];
 
-    if (tile_data_signed_id)
+    ppu->sprite_index_dirty = true;
+}
+
+void
+renderer_wake(Scanline_Renderer *renderer)
+{
+    // Taking the lock orders the wake after the render thread's last look at the queue
     {
-        tile_id = memory_bus->read_i8(tile_address);
-        tile_data_addr = tile_data_start_addr + ((tile_id + 128) * 16);
+        std::lock_guard<std::mutex> lock(renderer->mutex);
     }
-    else
+
+    renderer->ready.notify_one();
+}
+
+// address is the VRAM or OAM byte written, 0 queues the line value for drawing. A full queue waits
+// for the render thread to empty it
+void
+renderer_push(Scanline_Renderer *renderer, u16 address, u8 value)
+{
+    u32 write = renderer->write.load(std::memory_order_relaxed);
+
+    if (write - renderer->read.load(std::memory_order_acquire) == RENDER_QUEUE_SIZE)
+    {
+        renderer_wake(renderer);
+
+        std::unique_lock<std::mutex> lock(renderer->mutex);
+        renderer->drained.wait(lock, [renderer, write]() { return renderer->read.load(std::memory_order_acquire) == write; });
+    }
+
+    renderer->queue[write % RENDER_QUEUE_SIZE] = {address, value};
+    renderer->write.store(write + 1, std::memory_order_release);
+}
+
+// A tile whose data changes is redrawn in every map cell that shows it
+void
+track_vram_write(PPU *ppu, u8 *vram, u16 address, u8 value)
+{
+    u16 offset = address - VRAM_TILE_DATA_ADDRESS;
+
+    if (address < VRAM_TILE_MAP_ADDRESS && vram[offset] != value)
+    {
+        ppu->tile_version[offset / 16]++;
+    }
+}
+
+// Called by the bus before a VRAM write lands
+void
+ppu_write_vram(PPU *ppu, Memory_Bus *memory_bus, u16 address, u8 value)
+{
+    if (ppu->renderer)
     {
-        tile_id = memory_bus->read_u8(tile_address);
-        tile_data_addr = tile_data_start_addr + (tile_id * 16);
-    }            
+        renderer_push(ppu->renderer, address, value);
+        return;
+    }
 
-    u8 tile_vertical_line = pos_y % 8;
-    tile_vertical_line *= 2; // each vertical line is 2 bytes
+    track_vram_write(ppu, memory_bus->memory + VRAM_TILE_DATA_ADDRESS, address, value);
+}
 
-    u8 lo = memory_bus->read_u8(tile_data_addr + tile_vertical_line);
-    u8 hi = memory_bus->read_u8(tile_data_addr + tile_vertical_line + 1);
+// Called by the bus after an OAM byte is written, including by DMA
+void
+ppu_write_oam(PPU *ppu, Memory_Bus *memory_bus, u16 address)
+{
+    if (ppu->renderer)
+    {
+        renderer_push(ppu->renderer, address, memory_bus->memory[address]);
+        return;
+    }
 
-    u8 colour_bit = pos_x % 8;
-    // Pixel 0 is at bit 7, 1 is at bit 6 and so on. Therefore we need to adjust bit index
-    colour_bit -= 7;
-    colour_bit *= -1;
+    decode_oam_entry(ppu, memory_bus->memory + OAM_START_ADDRESS, (address - OAM_START_ADDRESS) / 4);
+}
 
-    // A single pixel colour is determined by the two bits in the two bytes making a 2 bit integer
-    hi = (hi >> colour_bit) & 0x01;
-    lo = (lo >> colour_bit) & 0x01;
-    u8 colour_num = (hi << 1) | lo;
+// Brings everything derived from VRAM and OAM back in line with the bus memory, for when it changed
+// behind the bus. Every map cell is redrawn on next use
+void
+ppu_invalidate_caches(PPU *ppu, Memory_Bus *memory_bus)
+{
+    ppu_render_sync(ppu);
 
-    return determine_colour(memory_bus, colour_num, BG_COLOUR_PALETTE_ADDRESS);
+    if (ppu->renderer)
+    {
+        memcpy(ppu->renderer->vram, memory_bus->memory + VRAM_TILE_DATA_ADDRESS, sizeof(ppu->renderer->vram));
+        memcpy(ppu->renderer->oam, memory_bus->memory + OAM_START_ADDRESS, sizeof(ppu->renderer->oam));
+        memcpy(ppu->renderer->frame_buffer, ppu->frame_buffer, sizeof(ppu->frame_buffer));
+    }
+
+    for (u8 sprite = 0; sprite < OAM_SPRITE_COUNT; ++sprite)
+    {
+        decode_oam_entry(ppu, memory_bus->memory + OAM_START_ADDRESS, sprite);
+    }
+
+    memset(ppu->map_cell_tile, 0xFF, sizeof(ppu->map_cell_tile));
 }
 
-u32
-calculate_sprite_pixel(PPU *ppu, Memory_Bus *memory_bus, u8 current_line, u32 pixel)
+// Buckets the first SPRITES_PER_LINE sprites in OAM order covering each line, then orders each
+// bucket by x. Insertion sort keeps OAM order between sprites at the same x
+void
+build_sprite_index(PPU *ppu, u8 height)
 {
-    // We go backwards as priority favours first valid
-    for (i8 sprite = SPRITE_COUNT - 1; sprite >= 0; --sprite) 
+    memset(ppu->line_sprite_count, 0, sizeof(ppu->line_sprite_count));
+
+    for (u8 sprite = 0; sprite < OAM_SPRITE_COUNT; ++sprite)
     {
-        if (!ppu->valid_oam_objects[sprite])
+        i16 top = ppu->oam_object[sprite].y_pos;
+        i16 start = top < 0 ? 0 : top;
+        i16 end = top + height > GAMEBOY_HEIGHT ? GAMEBOY_HEIGHT : top + height;
+
+        for (i16 line = start; line < end; ++line)
         {
-            continue;
+            if (ppu->line_sprite_count[line] < SPRITES_PER_LINE)
+            {
+                ppu->line_sprites[line][ppu->line_sprite_count[line]++] = sprite;
+            }
         }
+    }
 
-        if (ppu->oam_object[sprite].properties.obj_bg_priority && pixel != PALETTE_COLOURS[WHITE])
+    for (u8 line = 0; line < GAMEBOY_HEIGHT; ++line)
+    {
+        u8 *sprites = ppu->line_sprites[line];
+
+        for (u8 i = 1; i < ppu->line_sprite_count[line]; ++i)
         {
-            continue;
+            u8 sprite = sprites[i];
+            u8 j = i;
+
+            for (; j > 0 && ppu->oam_object[sprites[j - 1]].x_pos > ppu->oam_object[sprite].x_pos; --j)
+            {
+                sprites[j] = sprites[j - 1];
+            }
+
+            sprites[j] = sprite;
         }
+    }
+
+    ppu->sprite_index_height = height;
+    ppu->sprite_index_dirty = false;
+}
+
+// The STAT interrupt line is the OR of every enabled source and the interrupt is only requested
+// when it rises, so a source becoming true while another already holds the line is not seen.
+// Called whenever LY, LYC, STAT or the mode changes, the line is held low while the LCD is off
+void
+ppu_update_stat(PPU *ppu, Memory_Bus *memory_bus)
+{
+    u8 *memory = memory_bus->memory;
+    u8 lcd_status = memory[LCD_STATUS_REGISTER];
 
-        if (ppu->pixel > ppu->oam_object[sprite].x_pos + 8 || ppu->pixel < ppu->oam_object[sprite].x_pos)
+    if (memory[LY_REGISTER] == memory[LYC_REGISTER])
+    {
+        lcd_status |= LCD_STATUS_LYC_EQ_LY;
+    }
+    else
+    {
+        lcd_status &= ~LCD_STATUS_LYC_EQ_LY;
+    }
+
+    memory[LCD_STATUS_REGISTER] = lcd_status;
+
+    u8 mode = lcd_status & 0x03;
+    bool line = ((lcd_status & LCD_STATUS_LYC_INT_SELECT) && (lcd_status & LCD_STATUS_LYC_EQ_LY)) ||
+        ((lcd_status & LCD_STATUS_MODE_0_INT_SELECT) && mode == LCD_STATUS_PPU_MODE_0) ||
+        ((lcd_status & LCD_STATUS_MODE_1_INT_SELECT) && mode == LCD_STATUS_PPU_MODE_1) ||
+        ((lcd_status & LCD_STATUS_MODE_2_INT_SELECT) && mode == LCD_STATUS_PPU_MODE_2);
+
+    line = line && !ppu->lcd_off;
+
+    if (line && !ppu->stat_line)
+    {
+        perform_interrupt(memory_bus, INTERRUPT_LCD);
+    }
+
+    ppu->stat_line = line;
+}
+
+void
+set_lcd_status_ppu_mode(PPU *ppu, Memory_Bus *memory_bus, u8 mode)
+{
+    u8 lcd_status = memory_bus->memory[LCD_STATUS_REGISTER];
+
+    if ((lcd_status & 0x03) == mode)
+    {
+        return;
+    }
+
+    memory_bus->memory[LCD_STATUS_REGISTER] = (lcd_status & ~0x03) | mode;
+    ppu_update_stat(ppu, memory_bus);
+}
+
+bool
+window_visible(PPU_Line_Registers *registers, u8 current_line)
+{
+    return window_enabled(registers->lcdc) && registers->wy <= current_line && static_cast<u8>(registers->wx - 7) < GAMEBOY_WIDTH;
+}
+
+// Draws the background and window for a whole line from the map caches
+void
+draw_background_line(PPU *ppu, u8 *vram, PPU_Line_Registers *registers, u8 current_line, u8 *line)
+{
+    if (!bg_and_window_enabled(registers->lcdc))
+    {
+        memset(line, WHITE, GAMEBOY_WIDTH);
+        return;
+    }
+
+    bool signed_identifiers;
+    bg_window_tile_data_start_address(registers->lcdc, &signed_identifiers);
+
+    u8 shades[4];
+    bg_palette_shades(registers->bgp, shades);
+
+    u8 window_start = window_visible(registers, current_line) ? registers->wx - 7 : GAMEBOY_WIDTH;
+
+    if (window_start > 0)
+    {
+        u8 map = bg_tile_map_start_address(registers->lcdc) == VRAM_TILE_MAP_ADDRESS ? 0 : 1;
+        u8 pos_y = current_line + registers->scy; // y co-ordinate on the bg tile map
+
+        refresh_map_row(ppu, vram, map, pos_y / 8, signed_identifiers);
+        u8 *row = ppu->map_cache[map] + pos_y * BACKGROUND_WINDOW_WIDTH;
+
+        for (u8 x = 0; x < window_start; ++x)
         {
-            continue;
+            line[x] = shades[row[static_cast<u8>(x + registers->scx)]];
         }
+    }
 
-        u8 line = current_line - ppu->oam_object[sprite].y_pos;
+    if (window_start < GAMEBOY_WIDTH)
+    {
+        u8 map = window_tile_map_start_address(registers->lcdc) == VRAM_TILE_MAP_ADDRESS ? 0 : 1;
+        u8 pos_y = registers->window_line; // y co-ordinate on the window tile map
+
+        refresh_map_row(ppu, vram, map, pos_y / 8, signed_identifiers);
+        u8 *row = ppu->map_cache[map] + pos_y * BACKGROUND_WINDOW_WIDTH;
 
-        if (ppu->oam_object[sprite].properties.y_flip)
+        for (u8 x = window_start; x < GAMEBOY_WIDTH; ++x)
         {
-            line -= obj_height(memory_bus);
-            line *= -1;
+            line[x] = shades[row[x - window_start]];
         }
+    }
+}
+
+// The first opaque sprite in priority order wins, a sprite behind the background only shows over white
+u8
+calculate_sprite_pixel(PPU *ppu, u8 *vram, PPU_Line_Registers *registers, u8 current_line, u8 x, u8 pixel)
+{
+    u8 count = ppu->line_sprite_count[current_line];
+    u8 *sprites = ppu->line_sprites[current_line];
+    u8 height = ppu->sprite_index_height;
 
-        line *= 2; // 2 bytes per line
+    for (u8 i = 0; i < count; ++i)
+    {
+        PPU::OAM_Entry *object = &ppu->oam_object[sprites[i]];
+        i16 column = x - object->x_pos;
 
-        u16 sprite_data_addr = SPRITE_DATA_START_ADDR + (ppu->oam_object[sprite].tile * 16) + line;
-        u8 lo = memory_bus->read_u8(sprite_data_addr);
-        u8 hi = memory_bus->read_u8(sprite_data_addr + 1);
+        if (column < 0 || column > 7)
+        {
+            continue;
+        }
 
-        u8 colour_bit = ppu->pixel - ppu->oam_object[sprite].x_pos;
+        u8 line = current_line - object->y_pos;
 
-        if (!ppu->oam_object[sprite].properties.x_flip)
+        if (object->properties.y_flip)
         {
-            colour_bit -= 7;
-            colour_bit *= -1;
+            line = height - 1 - line;
         }
 
+        u8 tile = height == 16 ? object->tile & ~0x01 : object->tile;
+        u8 *sprite_data = vram + (tile * 16) + line * 2; // 2 bytes per line
+        u8 lo = sprite_data[0];
+        u8 hi = sprite_data[1];
+
+        u8 colour_bit = object->properties.x_flip ? column : 7 - column;
+
         hi = (hi >> colour_bit) & 0x01;
         lo = (lo >> colour_bit) & 0x01;
         u8 colour_num = (hi << 1) | lo;
@@ -329,120 +540,523 @@ calculate_sprite_pixel(PPU *ppu, Memory_Bus *memory_bus, u8 current_line, u32 pi
             continue;
         }
 
-        pixel = determine_colour(memory_bus, colour_num, ppu->oam_object[sprite].properties.pallete_number ? 0xFF49 : 0xFF48);
+        if (object->properties.obj_bg_priority && pixel != WHITE)
+        {
+            return pixel;
+        }
+
+        return determine_colour(registers->obp[object->properties.pallete_number], colour_num);
     }
 
     return pixel;
 }
 
-u32
-calculate_pixel(PPU *ppu, Memory_Bus *memory_bus, u8 current_line)
+// Luminance is 0xFF - 0x55 * shade, so a block only needs its shades summed and converts once. Every
+// valid downscale divides both 160 and 144 and so is a power of two, the average is a shift
+void
+observe_line(PPU *ppu, u8 *frame, u8 current_line)
 {
-    u32 pixel = PALETTE_COLOURS[WHITE];
-    
-    if (bg_and_window_enabled(memory_bus))
+    u8 factor = ppu->observation_downscale;
+    u8 width = GAMEBOY_WIDTH / factor;
+    u8 *line = frame + current_line * GAMEBOY_WIDTH;
+    u16 *sums = ppu->observation_sums;
+
+    if (current_line % factor == 0)
     {
-        pixel = calculate_bg_pixel(ppu, memory_bus, current_line);
+        memset(sums, 0, sizeof(ppu->observation_sums));
     }
-    
-    if (obj_enabled(memory_bus))
+
+    if (factor == 1)
     {
-        pixel = calculate_sprite_pixel(ppu, memory_bus, current_line, pixel);
+        for (u8 x = 0; x < GAMEBOY_WIDTH; ++x)
+        {
+            sums[x] = line[x];
+        }
+    }
+    else
+    {
+        // Neighbouring pixels are added in pairs first, which is the whole block width at downscale 2
+        u16 pairs[GAMEBOY_WIDTH / 2];
+        u8 x = 0;
+
+#ifdef PPU_SSE2
+        for (; x < GAMEBOY_WIDTH; x += 16)
+        {
+            __m128i shades = _mm_loadu_si128(reinterpret_cast<__m128i*>(line + x));
+            __m128i even = _mm_and_si128(shades, _mm_set1_epi16(0x00FF));
+            __m128i odd = _mm_srli_epi16(shades, 8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(pairs + x / 2), _mm_add_epi16(even, odd));
+        }
+#endif
+
+        for (; x < GAMEBOY_WIDTH; x += 2)
+        {
+            pairs[x / 2] = line[x] + line[x + 1];
+        }
+
+        u8 per_block = factor / 2;
+
+        for (u8 block = 0; block < width; ++block)
+        {
+            for (u8 i = 0; i < per_block; ++i)
+            {
+                sums[block] += pairs[block * per_block + i];
+            }
+        }
+    }
+
+    if (current_line % factor != factor - 1)
+    {
+        return;
+    }
+
+    u32 size = width * (GAMEBOY_HEIGHT / factor);
+    u8 *newest = ppu->observation + (ppu->observation_stack - 1) * size;
+
+    // The oldest frame drops off as the first row of a new one is written
+    if (current_line == factor - 1 && ppu->observation_stack > 1)
+    {
+        memmove(ppu->observation, ppu->observation + size, (ppu->observation_stack - 1) * size);
+    }
+
+    u8 *out = newest + (current_line / factor) * width;
+    u16 area = factor * factor;
+    u8 shift = 0;
+
+    while ((1 << shift) < area)
+    {
+        ++shift;
+    }
+
+    u8 x = 0;
+
+#ifdef PPU_SSE2
+    __m128i white = _mm_set1_epi16(static_cast<i16>(0xFF * area));
+    __m128i step = _mm_set1_epi16(0x55);
+
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i sum = _mm_loadu_si128(reinterpret_cast<__m128i*>(sums + x));
+        __m128i luminance = _mm_srl_epi16(_mm_sub_epi16(white, _mm_mullo_epi16(sum, step)), _mm_cvtsi32_si128(shift));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(luminance, luminance));
+    }
+#endif
+
+    for (; x < width; ++x)
+    {
+        out[x] = static_cast<u8>((0xFF * area - 0x55 * sums[x]) >> shift);
     }
-    
-    return pixel;
 }
 
-void 
-ppu_cycle(PPU *ppu, Memory_Bus *memory_bus)
+// Draws a whole line into frame with the registers latched as its pixel transfer started
+void
+render_line(PPU *ppu, u8 *vram, PPU_Line_Registers *registers, u8 current_line, u8 *frame)
 {
-    u8 lcd_status = memory_bus->read_u8(LCD_STATUS_REGISTER);
+    u8 *line = frame + current_line * GAMEBOY_WIDTH;
 
-    if (!lcd_ppu_enabled(memory_bus))
+    draw_background_line(ppu, vram, registers, current_line, line);
+
+    if (obj_enabled(registers->lcdc))
+    {
+        u8 sprite_height = obj_height(registers->lcdc);
+
+        if (ppu->sprite_index_dirty || ppu->sprite_index_height != sprite_height)
+        {
+            build_sprite_index(ppu, sprite_height);
+        }
+
+        if (ppu->line_sprite_count[current_line])
+        {
+            for (u8 x = 0; x < GAMEBOY_WIDTH; ++x)
+            {
+                line[x] = calculate_sprite_pixel(ppu, vram, registers, current_line, x, line[x]);
+            }
+        }
+    }
+
+    if (ppu->observation)
     {
-        memory_bus->memory[LY_REGISTER] = 0;
+        observe_line(ppu, frame, current_line);
+    }
+}
 
-        lcd_status &= 252;
-        lcd_status |= 0x01;
-        memory_bus->write_u8(LCD_STATUS_REGISTER, lcd_status);
+void
+renderer_thread(PPU *ppu)
+{
+    Scanline_Renderer *renderer = ppu->renderer;
 
-        ppu->mode = PPU::Mode::PIXEL_TRANSFER;
-        ppu->cycles = OAM_CYCLES;
+    for (;;)
+    {
+        u32 read = renderer->read.load(std::memory_order_relaxed);
+
+        if (read == renderer->write.load(std::memory_order_acquire))
+        {
+            std::unique_lock<std::mutex> lock(renderer->mutex);
+            renderer->drained.notify_all();
+            renderer->ready.wait(lock, [renderer, read]() { return renderer->write.load(std::memory_order_acquire) != read || !renderer->running; });
+
+            // Stopping still drains everything that was queued
+            if (renderer->write.load(std::memory_order_acquire) == read)
+            {
+                return;
+            }
+
+            continue;
+        }
 
-        memset(ppu->frame_buffer, PALETTE_COLOURS[WHITE], GAMEBOY_WIDTH * GAMEBOY_HEIGHT);
-        ppu->draw_frame = true; // We want to simulate the screen switching off
+        Scanline_Renderer::Command command = renderer->queue[read % RENDER_QUEUE_SIZE];
 
+        if (command.address == 0)
+        {
+            render_line(ppu, renderer->vram, &renderer->lines[command.value], command.value, renderer->frame_buffer);
+        }
+        else if (command.address >= OAM_START_ADDRESS)
+        {
+            renderer->oam[command.address - OAM_START_ADDRESS] = command.value;
+            decode_oam_entry(ppu, renderer->oam, (command.address - OAM_START_ADDRESS) / 4);
+        }
+        else
+        {
+            track_vram_write(ppu, renderer->vram, command.address, command.value);
+            renderer->vram[command.address - VRAM_TILE_DATA_ADDRESS] = command.value;
+        }
+
+        renderer->read.store(read + 1, std::memory_order_release);
+    }
+}
+
+// Latches the registers for the line and draws it, or queues it for the render thread. The window
+// line counter only moves on lines that show the window
+void
+draw_line(PPU *ppu, Memory_Bus *memory_bus, u8 current_line)
+{
+    u8 *memory = memory_bus->memory;
+    Scanline_Renderer *renderer = ppu->renderer;
+    PPU_Line_Registers registers;
+    PPU_Line_Registers *line_registers = renderer ? &renderer->lines[current_line] : &registers;
+
+    line_registers->lcdc = memory[LCD_CONTROL_REGISTER];
+    line_registers->scy = memory[SCY_REGISTER];
+    line_registers->scx = memory[SCX_REGISTER];
+    line_registers->wy = memory[WY_REGISTER];
+    line_registers->wx = memory[WX_REGISTER];
+    line_registers->bgp = memory[BG_COLOUR_PALETTE_ADDRESS];
+    line_registers->obp[0] = memory[SPRITE_COLOUR_PALETTE_ADDRESS[0]];
+    line_registers->obp[1] = memory[SPRITE_COLOUR_PALETTE_ADDRESS[1]];
+    line_registers->window_line = ppu->window_line_counter;
+
+    if (bg_and_window_enabled(line_registers->lcdc) && window_visible(line_registers, current_line))
+    {
+        ppu->window_used = true;
+    }
+
+    if (renderer)
+    {
+        renderer_push(renderer, 0, current_line);
+        renderer_wake(renderer);
         return;
     }
 
-    ppu->cycles++;
+    render_line(ppu, memory + VRAM_TILE_DATA_ADDRESS, line_registers, current_line, ppu->frame_buffer);
+}
 
-    u8 current_line = memory_bus->memory[LY_REGISTER];
+// Colour id of one background or window pixel, read straight from the tile map and tile data
+u8
+reference_map_pixel(u8 *memory, u16 map_address, u8 lcdc, u8 x, u8 y)
+{
+    bool signed_identifiers;
+    u16 data_address = bg_window_tile_data_start_address(lcdc, &signed_identifiers);
+    u8 identifier = memory[map_address + (y / 8) * 32 + x / 8];
+
+    u16 tile_address = signed_identifiers ? data_address + (static_cast<i8>(identifier) + 128) * 16 : data_address + identifier * 16;
+    u8 lo = memory[tile_address + (y % 8) * 2];
+    u8 hi = memory[tile_address + (y % 8) * 2 + 1];
+    u8 bit = 7 - (x % 8);
+
+    return (((hi >> bit) & 0x01) << 1) | ((lo >> bit) & 0x01);
+}
+
+// The lockstep reference draws every pixel from the bus memory as the line starts, with no map
+// caches, decoded OAM or sprite index. Sprites are the first SPRITES_PER_LINE in OAM order on the
+// line, the opaque one with the lowest x (then OAM index) wins a pixel
+void
+draw_line_reference(PPU *ppu, Memory_Bus *memory_bus, u8 current_line)
+{
+    u8 *memory = memory_bus->memory;
+    u8 lcdc = memory[LCD_CONTROL_REGISTER];
+    u8 scy = memory[SCY_REGISTER];
+    u8 scx = memory[SCX_REGISTER];
+    u8 wy = memory[WY_REGISTER];
+    u8 wx = memory[WX_REGISTER];
+    u8 *line = ppu->frame_buffer + current_line * GAMEBOY_WIDTH;
 
-    if (current_line == memory_bus->read_u8(LYC_REGISTER))
+    bool window = bg_and_window_enabled(lcdc) && window_enabled(lcdc) && wy <= current_line && static_cast<u8>(wx - 7) < GAMEBOY_WIDTH;
+
+    for (u8 x = 0; x < GAMEBOY_WIDTH; ++x)
     {
-        lcd_status |= 0x04;
-        memory_bus->write_u8(LCD_STATUS_REGISTER, lcd_status);
+        u8 id = WHITE;
 
-        if (lcd_status & 0x40)
+        if (window && x >= static_cast<u8>(wx - 7))
         {
-            perform_interrupt(memory_bus, INTERRUPT_LCD);
+            id = reference_map_pixel(memory, window_tile_map_start_address(lcdc), lcdc, x - (wx - 7), ppu->window_line_counter);
         }
+        else if (bg_and_window_enabled(lcdc))
+        {
+            id = reference_map_pixel(memory, bg_tile_map_start_address(lcdc), lcdc, x + scx, current_line + scy);
+        }
+
+        line[x] = bg_and_window_enabled(lcdc) ? (memory[BG_COLOUR_PALETTE_ADDRESS] >> (id * 2)) & 0x03 : WHITE;
     }
-    else
+
+    if (window)
     {
-        lcd_status &= ~0x04;
-        memory_bus->write_u8(LCD_STATUS_REGISTER, lcd_status);
+        ppu->window_used = true;
     }
 
-    switch (ppu->mode)
+    if (obj_enabled(lcdc))
     {
-        case PPU::Mode::OAM:
-            if (ppu->cycles == 0)
+        u8 height = obj_height(lcdc);
+        u8 sprites[SPRITES_PER_LINE];
+        u8 count = 0;
+
+        for (u8 sprite = 0; sprite < OAM_SPRITE_COUNT && count < SPRITES_PER_LINE; ++sprite)
+        {
+            i16 top = memory[OAM_START_ADDRESS + sprite * 4] - 16;
+
+            if (current_line >= top && current_line < top + height)
             {
-                set_lcd_status_ppu_mode(memory_bus, LCD_STATUS_PPU_MODE_2, lcd_status);
+                sprites[count++] = sprite;
             }
+        }
 
-            if (ppu->cycles == OAM_CYCLES)
+        for (u8 x = 0; x < GAMEBOY_WIDTH; ++x)
+        {
+            i16 best_x = 0;
+            u8 best_colour = WHITE;
+            u8 best_attributes = 0;
+
+            for (u8 i = 0; i < count; ++i)
             {
-                u8 sprite_height = obj_height(memory_bus);
-                u8 count = 0;
-                
-                for (u8 sprite = 0; sprite < SPRITE_COUNT; ++sprite)
+                u8 *entry = memory + OAM_START_ADDRESS + sprites[i] * 4;
+                i16 left = entry[1] - 8;
+                i16 column = x - left;
+
+                if (column < 0 || column > 7 || (best_colour != WHITE && left >= best_x))
                 {
-                    u8 offset = sprite * 4;
-                    ppu->oam_object[sprite].y_pos = memory_bus->read_i8(OAM_START_ADDRESS + offset) - 16;
-                    ppu->oam_object[sprite].x_pos = memory_bus->read_i8(OAM_START_ADDRESS + offset + 1) - 8;
-                    ppu->oam_object[sprite].tile = memory_bus->read_u8(OAM_START_ADDRESS + offset + 2);
-                    ppu->oam_object[sprite].properties.byte = memory_bus->read_u8(OAM_START_ADDRESS  + offset + 3);
+                    continue;
+                }
 
-                    if (sprite_height == 16)
-                    {
-                        ppu->oam_object[sprite].tile &= ~0x01;
-                    }
+                u8 row = current_line - (entry[0] - 16);
+                row = entry[3] & 0x40 ? height - 1 - row : row;
 
-                    i8 y_pos = ppu->oam_object[sprite].y_pos;
-                    if (count < 10 && y_pos <= current_line && (y_pos + sprite_height) > current_line)
-                    {
-                        ppu->valid_oam_objects[sprite] = true;
-                        ++count;
-                    }
-                    else
-                    {
-                        ppu->valid_oam_objects[sprite] = false;
-                    }
+                u8 tile = height == 16 ? entry[2] & ~0x01 : entry[2];
+                u8 lo = memory[VRAM_TILE_DATA_ADDRESS + tile * 16 + row * 2];
+                u8 hi = memory[VRAM_TILE_DATA_ADDRESS + tile * 16 + row * 2 + 1];
+                u8 bit = entry[3] & 0x20 ? column : 7 - column;
+                u8 colour = (((hi >> bit) & 0x01) << 1) | ((lo >> bit) & 0x01);
+
+                if (colour != WHITE)
+                {
+                    best_x = left;
+                    best_colour = colour;
+                    best_attributes = entry[3];
                 }
+            }
+
+            if (best_colour == WHITE || ((best_attributes & 0x80) && line[x] != WHITE))
+            {
+                continue;
+            }
 
+            line[x] = determine_colour(memory[SPRITE_COLOUR_PALETTE_ADDRESS[(best_attributes >> 4) & 0x01]], best_colour);
+        }
+    }
+
+    if (ppu->observation)
+    {
+        observe_line(ppu, ppu->frame_buffer, current_line);
+    }
+}
+
+// Waits until the render thread has applied every queued write and drawn every queued line
+void
+ppu_render_sync(PPU *ppu)
+{
+    Scanline_Renderer *renderer = ppu->renderer;
+
+    if (!renderer)
+    {
+        return;
+    }
+
+    u32 write = renderer->write.load(std::memory_order_relaxed);
+
+    if (renderer->read.load(std::memory_order_acquire) == write)
+    {
+        return;
+    }
+
+    renderer_wake(renderer);
+
+    std::unique_lock<std::mutex> lock(renderer->mutex);
+    renderer->drained.wait(lock, [renderer, write]() { return renderer->read.load(std::memory_order_acquire) == write; });
+}
+
+// Lines are drawn on a second thread from here on, the frame buffer only changes at VBLANK
+bool
+ppu_start_renderer(PPU *ppu, Memory_Bus *memory_bus)
+{
+    if (ppu->renderer)
+    {
+        return true;
+    }
+
+    Scanline_Renderer *renderer = new Scanline_Renderer();
+    memcpy(renderer->vram, memory_bus->memory + VRAM_TILE_DATA_ADDRESS, sizeof(renderer->vram));
+    memcpy(renderer->oam, memory_bus->memory + OAM_START_ADDRESS, sizeof(renderer->oam));
+    memcpy(renderer->frame_buffer, ppu->frame_buffer, sizeof(renderer->frame_buffer));
+
+    renderer->read.store(0, std::memory_order_relaxed);
+    renderer->write.store(0, std::memory_order_relaxed);
+    renderer->running = true;
+
+    ppu->renderer = renderer;
+    renderer->thread = std::thread(renderer_thread, ppu);
+
+    printf("[PPU] Drawing lines on a render thread\n");
+
+    return true;
+}
+
+void
+ppu_stop_renderer(PPU *ppu)
+{
+    Scanline_Renderer *renderer = ppu->renderer;
+
+    if (!renderer)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(renderer->mutex);
+        renderer->running = false;
+    }
+
+    renderer->ready.notify_one();
+    renderer->thread.join();
+
+    // Keep the lines drawn since the last VBLANK, as drawing on this thread would have
+    memcpy(ppu->frame_buffer, renderer->frame_buffer, sizeof(ppu->frame_buffer));
+
+    ppu->renderer = NULL;
+    delete renderer;
+}
+
+// Counted from power on, so which frames are drawn does not depend on when frame_skip was set
+bool
+frame_skipped(PPU *ppu)
+{
+    if (ppu->frame_skip == FRAME_SKIP_ALL)
+    {
+        return true;
+    }
+
+    return ppu->frame_count % (ppu->frame_skip + 1) != 0;
+}
+
+void
+ppu_switch_off(PPU *ppu, Memory_Bus *memory_bus)
+{
+    ppu->lcd_off = true;
+
+    memory_bus->memory[LY_REGISTER] = 0;
+    memory_bus->memory[LCD_STATUS_REGISTER] = (memory_bus->memory[LCD_STATUS_REGISTER] & ~0x03) | LCD_STATUS_PPU_MODE_0;
+    ppu_update_stat(ppu, memory_bus);
+
+    ppu->mode = PPU::Mode::PIXEL_TRANSFER;
+    ppu->cycles = OAM_CYCLES;
+    ppu->pixel = 0;
+
+    ppu_render_sync(ppu);
+
+    memset(ppu->frame_buffer, WHITE, sizeof(ppu->frame_buffer));
+    ppu->draw_frame = true; // We want to simulate the screen switching off
+
+    if (ppu->renderer)
+    {
+        memset(ppu->renderer->frame_buffer, WHITE, sizeof(ppu->renderer->frame_buffer));
+    }
+
+    if (ppu->observation)
+    {
+        for (u8 line = 0; line < GAMEBOY_HEIGHT; ++line)
+        {
+            observe_line(ppu, ppu->frame_buffer, line);
+        }
+    }
+}
+
+// Debug_Views selects the variant that also draws the tile view with every drawn frame, Reference
+// the one lockstep compares against that draws lines with draw_line_reference
+template <bool Debug_Views, bool Reference>
+void 
+ppu_cycle(PPU *ppu, Memory_Bus *memory_bus)
+{
+    // With the LCD off the PPU sleeps until LCDC bit 7 is set again, the screen is blanked and
+    // presented once on the way in
+    if (!lcd_ppu_enabled(memory_bus))
+    {
+        if (!ppu->lcd_off)
+        {
+            ppu_switch_off(ppu, memory_bus);
+        }
+
+        return;
+    }
+
+    // Line 0 starts in pixel transfer, so only LYC can raise the STAT line on the way in
+    if (ppu->lcd_off)
+    {
+        ppu->lcd_off = false;
+        memory_bus->memory[LCD_STATUS_REGISTER] = (memory_bus->memory[LCD_STATUS_REGISTER] & ~0x03) | LCD_STATUS_PPU_MODE_3;
+        ppu_update_stat(ppu, memory_bus);
+    }
+
+    ppu->cycles++;
+
+    u8 current_line = memory_bus->memory[LY_REGISTER];
+
+    switch (ppu->mode)
+    {
+        case PPU::Mode::OAM:
+            if (ppu->cycles == 1)
+            {
+                set_lcd_status_ppu_mode(ppu, memory_bus, LCD_STATUS_PPU_MODE_2);
+            }
+
+            if (ppu->cycles == OAM_CYCLES)
+            {
                 ppu->mode = PPU::Mode::PIXEL_TRANSFER;
             }
             break;
         case PPU::Mode::PIXEL_TRANSFER:
             if (ppu->pixel == 0)
             {
-                set_lcd_status_ppu_mode(memory_bus, LCD_STATUS_PPU_MODE_3, lcd_status);
-            }
+                set_lcd_status_ppu_mode(ppu, memory_bus, LCD_STATUS_PPU_MODE_3);
 
-            ppu->frame_buffer[ppu->pixel + (current_line * GAMEBOY_WIDTH)] = calculate_pixel(ppu, memory_bus, current_line);
+                if (!ppu->skip_frame)
+                {
+                    if constexpr (Reference)
+                    {
+                        draw_line_reference(ppu, memory_bus, current_line);
+                    }
+                    else
+                    {
+                        draw_line(ppu, memory_bus, current_line);
+                    }
+                }
+            }
 
             if (ppu->pixel == 159)
             {
@@ -465,7 +1079,7 @@ ppu_cycle(PPU *ppu, Memory_Bus *memory_bus)
             // which is the same amount of cycles vblank takes
             if (ppu->pixel == 0)
             {
-                set_lcd_status_ppu_mode(memory_bus, LCD_STATUS_PPU_MODE_0, lcd_status);
+                set_lcd_status_ppu_mode(ppu, memory_bus, LCD_STATUS_PPU_MODE_0);
             }
 
             if (ppu->cycles == (HBLANK_CYCLES + PIXEL_TRANSFER_CYCLES + OAM_CYCLES))
@@ -474,11 +1088,30 @@ ppu_cycle(PPU *ppu, Memory_Bus *memory_bus)
                 {
                     ppu->mode = PPU::Mode::VBLANK;
                     perform_interrupt(memory_bus, INTERRUPT_VBLANK);
-                    
-                    ppu->draw_frame = true;
 
-                    draw_vram_tiles(ppu, memory_bus);
-                    ppu->draw_tile_buffer = true;
+                    ppu->frame_count++;
+
+                    if (!ppu->skip_frame)
+                    {
+                        if (ppu->renderer)
+                        {
+                            ppu_render_sync(ppu);
+                            memcpy(ppu->frame_buffer, ppu->renderer->frame_buffer, sizeof(ppu->frame_buffer));
+                        }
+
+                        ppu->draw_frame = true;
+
+                        if constexpr (Debug_Views)
+                        {
+                            ppu_draw_tiles(ppu, memory_bus);
+                            ppu->draw_tile_buffer = true;
+                        }
+
+                        if (ppu->frame_callback)
+                        {
+                            ppu->frame_callback(ppu->frame_callback_user, ppu);
+                        }
+                    }
                 }
                 else
                 {
@@ -486,13 +1119,14 @@ ppu_cycle(PPU *ppu, Memory_Bus *memory_bus)
                 }
                 
                 memory_bus->memory[LY_REGISTER]++;
+                ppu_update_stat(ppu, memory_bus);
                 ppu->cycles = 0;
             }
             break;
         case PPU::Mode::VBLANK:
             if (current_line == 144)
             {
-                set_lcd_status_ppu_mode(memory_bus, LCD_STATUS_PPU_MODE_1, lcd_status);
+                set_lcd_status_ppu_mode(ppu, memory_bus, LCD_STATUS_PPU_MODE_1);
             }
 
             if (ppu->cycles == VBLANK_CYCLES)
@@ -502,22 +1136,55 @@ ppu_cycle(PPU *ppu, Memory_Bus *memory_bus)
                     memory_bus->memory[LY_REGISTER] = 0;
                     ppu->mode = PPU::Mode::OAM;
                     ppu->window_line_counter = 0;
+                    ppu->skip_frame = frame_skipped(ppu);
                 }
                 else
                 {
                     memory_bus->memory[LY_REGISTER]++;
                 }
 
+                ppu_update_stat(ppu, memory_bus);
                 ppu->cycles = 0;
             }
             break;
     }
 }
 
+template void ppu_cycle<false, false>(PPU *ppu, Memory_Bus *memory_bus);
+template void ppu_cycle<true, false>(PPU *ppu, Memory_Bus *memory_bus);
+template void ppu_cycle<false, true>(PPU *ppu, Memory_Bus *memory_bus);
+
+// buffer holds stack observations of (144 / downscale) x (160 / downscale), NULL stops observing
+bool
+ppu_set_observation(PPU *ppu, u8 *buffer, u8 downscale, u8 stack)
+{
+    if (buffer && (downscale == 0 || stack == 0 || GAMEBOY_WIDTH % downscale || GAMEBOY_HEIGHT % downscale))
+    {
+        printf("[PPU] Invalid observation downscaled by %u stacking %u frames\n", downscale, stack);
+        return false;
+    }
+
+    ppu_render_sync(ppu);
+
+    ppu->observation = buffer;
+    ppu->observation_downscale = downscale;
+    ppu->observation_stack = stack;
+
+    return true;
+}
+
 void 
 ppu_init(PPU *ppu, Memory_Bus *memory_bus)
 {
     printf("[PPU] reset state\n");
+    ppu->frame_count = 0;
+    ppu->frame_skip = 0;
+    ppu->skip_frame = false;
+    ppu->lcd_off = false;
+    ppu->stat_line = false;
     ppu->draw_frame = false;
+
+    ppu_invalidate_caches(ppu, memory_bus);
     ppu->draw_tile_buffer = false;
+    ppu->debug_views = false;
 }
\ No newline at end of file
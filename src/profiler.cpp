@@ -0,0 +1,176 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+constexpr u32 PROFILER_REPORT_LOCATIONS = 64;
+
+const char *COMPONENT_NAMES[Profiler::COMPONENT_COUNT] = {"cpu", "ppu", "timers"};
+
+void
+profiler_init(Profiler *profiler)
+{
+    memset(profiler->opcode_counts, 0, sizeof(profiler->opcode_counts));
+    memset(profiler->extended_opcode_counts, 0, sizeof(profiler->extended_opcode_counts));
+    memset(profiler->component_ns, 0, sizeof(profiler->component_ns));
+    memset(profiler->component_calls, 0, sizeof(profiler->component_calls));
+
+    profiler->location_cycles.clear();
+    profiler->current_location = 0;
+    profiler->pending_cycles = 0;
+}
+
+void
+profiler_flush(Profiler *profiler)
+{
+    if (profiler->pending_cycles)
+    {
+        profiler->location_cycles[profiler->current_location] += profiler->pending_cycles;
+        profiler->pending_cycles = 0;
+    }
+}
+
+void
+format_location(char *out, size_t size, u32 location)
+{
+    u32 bank = location >> 16;
+    u16 pc = location & 0xFFFF;
+
+    if (bank == PROFILER_NON_ROM_BANK)
+    {
+        snprintf(out, size, "RAM:%04X", pc);
+    }
+    else
+    {
+        snprintf(out, size, "ROM%02X:%04X", bank, pc);
+    }
+}
+
+void
+write_opcode_table(FILE *file, const char *title, u64 *counts, u64 total)
+{
+    std::vector<u16> order;
+
+    for (u16 i = 0; i < 256; ++i)
+    {
+        if (counts[i])
+        {
+            order.push_back(i);
+        }
+    }
+
+    std::sort(order.begin(), order.end(), [counts](u16 a, u16 b) { return counts[a] > counts[b]; });
+
+    fprintf(file, "\n%s\n", title);
+
+    for (u16 opcode : order)
+    {
+        fprintf(file, "  %02X %14llu %6.2f%%\n", opcode, static_cast<unsigned long long>(counts[opcode]), 100.0 * counts[opcode] / total);
+    }
+}
+
+// Writes <prefix>.txt as a flat profile and <prefix>.folded as folded stacks (host ns) for flamegraph.pl
+bool
+profiler_write_report(Profiler *profiler, char *path_prefix)
+{
+    profiler_flush(profiler);
+
+    std::string flat_path = std::string(path_prefix) + ".txt";
+    std::string folded_path = std::string(path_prefix) + ".folded";
+
+    FILE *flat = fopen(flat_path.c_str(), "w");
+    FILE *folded = fopen(folded_path.c_str(), "w");
+
+    if (!flat || !folded)
+    {
+        printf("[Profiler] Unable to write report to %s\n", path_prefix);
+
+        if (flat) fclose(flat);
+        if (folded) fclose(folded);
+
+        return false;
+    }
+
+    u64 total_ns = 0;
+
+    for (u8 i = 0; i < Profiler::COMPONENT_COUNT; ++i)
+    {
+        total_ns += profiler->component_ns[i];
+    }
+
+    fprintf(flat, "Host time per component\n");
+
+    for (u8 i = 0; i < Profiler::COMPONENT_COUNT; ++i)
+    {
+        u64 calls = profiler->component_calls[i];
+        fprintf(flat, "  %-8s %12.3f ms %6.2f%% %8.2f ns/call\n", COMPONENT_NAMES[i], profiler->component_ns[i] / 1e6,
+            total_ns ? 100.0 * profiler->component_ns[i] / total_ns : 0.0,
+            calls ? static_cast<double>(profiler->component_ns[i]) / calls : 0.0);
+    }
+
+    u64 total_opcodes = 0;
+    u64 total_extended = 0;
+
+    for (u16 i = 0; i < 256; ++i)
+    {
+        total_opcodes += profiler->opcode_counts[i];
+        total_extended += profiler->extended_opcode_counts[i];
+    }
+
+    write_opcode_table(flat, "Executed opcodes", profiler->opcode_counts, total_opcodes);
+    write_opcode_table(flat, "Executed CB opcodes", profiler->extended_opcode_counts, total_extended);
+
+    std::vector<std::pair<u32, u64>> locations(profiler->location_cycles.begin(), profiler->location_cycles.end());
+    std::sort(locations.begin(), locations.end(), [](auto &a, auto &b) { return a.second > b.second; });
+
+    u64 total_cycles = 0;
+
+    for (auto &location : locations)
+    {
+        total_cycles += location.second;
+    }
+
+    fprintf(flat, "\nCPU cycles per bank:pc (top %u)\n", PROFILER_REPORT_LOCATIONS);
+
+    char name[16];
+
+    for (u32 i = 0; i < locations.size() && i < PROFILER_REPORT_LOCATIONS; ++i)
+    {
+        format_location(name, sizeof(name), locations[i].first);
+        fprintf(flat, "  %-12s %14llu %6.2f%%\n", name, static_cast<unsigned long long>(locations[i].second), 100.0 * locations[i].second / total_cycles);
+    }
+
+    // CPU host time is split across locations by their share of emulated cycles
+    for (auto &location : locations)
+    {
+        u32 bank = location.first >> 16;
+        // In double, the u64 product of host time and cycles overflows after about a minute
+        u64 ns = total_cycles ? static_cast<u64>(static_cast<double>(location.second) / total_cycles * profiler->component_ns[Profiler::CPU]) : 0;
+
+        format_location(name, sizeof(name), location.first);
+
+        if (bank == PROFILER_NON_ROM_BANK)
+        {
+            fprintf(folded, "gameboy;cpu;RAM;%s %llu\n", name, static_cast<unsigned long long>(ns));
+        }
+        else
+        {
+            fprintf(folded, "gameboy;cpu;ROM%02X;%s %llu\n", bank, name, static_cast<unsigned long long>(ns));
+        }
+    }
+
+    for (u8 i = Profiler::PPU; i < Profiler::COMPONENT_COUNT; ++i)
+    {
+        fprintf(folded, "gameboy;%s %llu\n", COMPONENT_NAMES[i], static_cast<unsigned long long>(profiler->component_ns[i]));
+    }
+
+    fclose(flat);
+    fclose(folded);
+
+    printf("[Profiler] Report written to %s and %s\n", flat_path.c_str(), folded_path.c_str());
+
+    return true;
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include "types.h"
+
+#include <chrono>
+#include <unordered_map>
+
+// Build with /DEMULATOR_PROFILE to enable. When disabled every hook below is an empty inline
+// function and Profile_Scope is an empty struct so nothing is left in the emulation loop
+#ifdef EMULATOR_PROFILE
+constexpr bool PROFILER_ENABLED = true;
+#else
+constexpr bool PROFILER_ENABLED = false;
+#endif
+
+// Locations at or above 0x8000 are not banked ROM and are grouped under this bank id
+constexpr u32 PROFILER_NON_ROM_BANK = 0x100;
+
+struct Profiler
+{
+    enum Component : u8
+    {
+        CPU,
+        PPU,
+        TIMERS,
+        COMPONENT_COUNT
+    };
+
+    u64 opcode_counts[256];
+    u64 extended_opcode_counts[256];
+
+    std::unordered_map<u32, u64> location_cycles; // key is (bank << 16) | pc of the instruction
+    u32 current_location;
+    u64 pending_cycles; // cycles spent in current_location not yet added to location_cycles
+
+    u64 component_ns[COMPONENT_COUNT];
+    u64 component_calls[COMPONENT_COUNT];
+};
+
+void profiler_init(Profiler *profiler);
+void profiler_flush(Profiler *profiler);
+bool profiler_write_report(Profiler *profiler, char *path_prefix);
+
+inline void
+profile_opcode(Profiler *profiler, u8 opcode, bool extended)
+{
+    if constexpr (PROFILER_ENABLED)
+    {
+        if (extended)
+        {
+            profiler->extended_opcode_counts[opcode]++;
+        }
+        else
+        {
+            profiler->opcode_counts[opcode]++;
+        }
+    }
+}
+
+// Called when an instruction is fetched, the cycles accumulated so far belong to the previous one
+inline void
+profile_instruction_start(Profiler *profiler, u8 rom_bank, u16 pc)
+{
+    if constexpr (PROFILER_ENABLED)
+    {
+        if (profiler->pending_cycles)
+        {
+            profiler->location_cycles[profiler->current_location] += profiler->pending_cycles;
+            profiler->pending_cycles = 0;
+        }
+
+        u32 bank = pc < 0x4000 ? 0 : pc < 0x8000 ? rom_bank : PROFILER_NON_ROM_BANK;
+        profiler->current_location = (bank << 16) | pc;
+    }
+}
+
+inline void
+profile_cpu_cycle(Profiler *profiler)
+{
+    if constexpr (PROFILER_ENABLED)
+    {
+        profiler->pending_cycles++;
+    }
+}
+
+template <bool Enabled>
+struct Profile_Scope_Impl
+{
+    Profile_Scope_Impl(Profiler *, Profiler::Component) {}
+};
+
+template <>
+struct Profile_Scope_Impl<true>
+{
+    Profiler *profiler;
+    Profiler::Component component;
+    std::chrono::steady_clock::time_point start;
+
+    Profile_Scope_Impl(Profiler *profiler, Profiler::Component component)
+        : profiler(profiler), component(component), start(std::chrono::steady_clock::now())
+    {
+    }
+
+    ~Profile_Scope_Impl()
+    {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        profiler->component_ns[component] += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        profiler->component_calls[component]++;
+    }
+};
+
+// Adds the host time spent until the end of the enclosing scope to a component
+typedef Profile_Scope_Impl<PROFILER_ENABLED> Profile_Scope;
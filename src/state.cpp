@@ -0,0 +1,171 @@
+#include "emulator.h"
+
+#include <cstring>
+
+constexpr u32 STATE_MAGIC = 0x54534247; // "GBST"
+constexpr u32 STATE_VERSION = 5;
+
+// The same walk over the GameBoy saves, loads and, without data, measures the state
+struct State_Stream
+{
+    u8 *data;
+    u64 size;
+    u64 position;
+    bool load;
+};
+
+template <typename T>
+void
+transfer(State_Stream *stream, T *value)
+{
+    if (stream->data && stream->position + sizeof(T) <= stream->size)
+    {
+        if (stream->load)
+        {
+            memcpy(value, stream->data + stream->position, sizeof(T));
+        }
+        else
+        {
+            memcpy(stream->data + stream->position, value, sizeof(T));
+        }
+    }
+
+    stream->position += sizeof(T);
+}
+
+// Host side state (sinks, profiler, trace, movie, windows) and the PPU debug views are not part of the state
+void
+transfer_gameboy(State_Stream *stream, GameBoy *gb)
+{
+    Memory_Bus *memory_bus = &gb->memory_bus;
+    Cartridge *cartridge = &memory_bus->cartridge;
+    CPU *cpu = &gb->cpu;
+    PPU *ppu = &gb->ppu;
+    APU *apu = &gb->apu;
+
+    transfer(stream, &memory_bus->memory);
+    transfer(stream, &memory_bus->cycles);
+    transfer(stream, &memory_bus->joypad);
+
+    transfer(stream, &cartridge->rom_bank_enabled);
+    transfer(stream, &cartridge->ram_bank_enabled);
+    transfer(stream, &cartridge->current_rom_bank);
+    transfer(stream, &cartridge->current_ram_bank);
+    transfer(stream, &cartridge->ram_banks);
+
+    transfer(stream, &cpu->registers);
+    transfer(stream, &cpu->pc);
+    transfer(stream, &cpu->sp);
+    transfer(stream, &cpu->w);
+    transfer(stream, &cpu->z);
+    transfer(stream, &cpu->tick);
+    transfer(stream, &cpu->interrupt_master_enable);
+    transfer(stream, &cpu->halted);
+    transfer(stream, &cpu->extended);
+
+    transfer(stream, &gb->timers);
+
+    transfer(stream, &ppu->cycles);
+    transfer(stream, &ppu->mode);
+    transfer(stream, &ppu->pixel);
+    transfer(stream, &ppu->window_line_counter);
+    transfer(stream, &ppu->window_used);
+    transfer(stream, &ppu->oam_object);
+    transfer(stream, &ppu->frame_buffer);
+    transfer(stream, &ppu->frame_count);
+    transfer(stream, &ppu->lcd_off);
+    transfer(stream, &ppu->stat_line);
+
+    transfer(stream, &apu->channels);
+    transfer(stream, &apu->sweep_shadow);
+    transfer(stream, &apu->sweep_timer);
+    transfer(stream, &apu->sweep_enabled);
+    transfer(stream, &apu->sequencer_step);
+    transfer(stream, &apu->sequencer_timer);
+    transfer(stream, &apu->registers);
+    transfer(stream, &apu->block_start);
+    transfer(stream, &apu->time);
+    transfer(stream, &apu->blip);
+}
+
+void
+transfer_header(State_Stream *stream, u32 *magic, u32 *version, u64 *rom_hash)
+{
+    transfer(stream, magic);
+    transfer(stream, version);
+    transfer(stream, rom_hash);
+}
+
+// The CPU pipeline holds closures that cannot be stored, so the core is first run to the next
+// instruction boundary (a handful of cycles at most). Returns the size of the state and only writes
+// it when capacity is large enough, call with a NULL buffer to query the size
+u64
+gameboy_save_state(GameBoy *gb, u8 *buffer, u64 capacity)
+{
+    State_Stream stream = {NULL, 0, 0, false};
+    u32 magic = STATE_MAGIC;
+    u32 version = STATE_VERSION;
+    u64 rom_hash = hash_bytes(gb->memory_bus.cartridge.data, gb->memory_bus.cartridge.size);
+
+    transfer_header(&stream, &magic, &version, &rom_hash);
+    transfer_gameboy(&stream, gb);
+
+    u64 size = stream.position;
+
+    if (!buffer || capacity < size)
+    {
+        return size;
+    }
+
+    while (gb->cpu.state != CPU::STATE::READ_OPCODE)
+    {
+        gameboy_run_cycles(gb, 1);
+    }
+
+    // The render thread owns the decoded OAM and the line sprites until it is idle
+    ppu_render_sync(&gb->ppu);
+
+    stream = {buffer, capacity, 0, false};
+    transfer_header(&stream, &magic, &version, &rom_hash);
+    transfer_gameboy(&stream, gb);
+
+    return size;
+}
+
+bool
+gameboy_load_state(GameBoy *gb, u8 *buffer, u64 size)
+{
+    State_Stream stream = {NULL, 0, 0, false};
+    u32 magic = 0;
+    u32 version = 0;
+    u64 rom_hash = 0;
+
+    transfer_header(&stream, &magic, &version, &rom_hash);
+    transfer_gameboy(&stream, gb);
+
+    if (size != stream.position)
+    {
+        return false;
+    }
+
+    stream = {buffer, size, 0, true};
+    transfer_header(&stream, &magic, &version, &rom_hash);
+
+    if (magic != STATE_MAGIC || version != STATE_VERSION ||
+        rom_hash != hash_bytes(gb->memory_bus.cartridge.data, gb->memory_bus.cartridge.size))
+    {
+        return false;
+    }
+
+    ppu_render_sync(&gb->ppu);
+    transfer_gameboy(&stream, gb);
+
+    ppu_invalidate_caches(&gb->ppu, &gb->memory_bus);
+    memory_bus_update_interrupts(&gb->memory_bus);
+
+    gb->cpu.state = CPU::STATE::READ_OPCODE;
+    gb->cpu.pipeline.pos = 0;
+    gb->cpu.pipeline.next_insert = 0;
+
+    return true;
+}
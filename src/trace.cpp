@@ -0,0 +1,124 @@
+#include "trace.h"
+
+#include <chrono>
+#include <cstring>
+
+const char *TRACE_LEVEL_NAMES[] = {"debug", "info", "warning", "critical", "off"};
+
+const char *TRACE_EVENT_FORMATS[static_cast<u16>(Trace_Event::COUNT)] = {
+    "[Emulator] simulated %u cycles, %u us since last batch",
+    "[Cartridge] ROM bank changed to: %u",
+    "[Cartridge] RAM bank changed to: %u",
+    "[Cartridge] RAM enabled: %u",
+    "[CPU] Serial interrupt triggered",
+};
+
+u32
+drain_records(Trace *trace)
+{
+    u32 read = trace->read.load(std::memory_order_relaxed);
+    u32 write = trace->write.load(std::memory_order_acquire);
+
+    for (u32 i = read; i != write; ++i)
+    {
+        Trace_Record *record = &trace->records[i & (TRACE_RING_SIZE - 1)];
+
+        fprintf(trace->file, "%12llu %-7s ", static_cast<unsigned long long>(record->cycle), TRACE_LEVEL_NAMES[static_cast<u8>(record->level)]);
+        fprintf(trace->file, TRACE_EVENT_FORMATS[static_cast<u16>(record->event)], record->a, record->b);
+        fputc('\n', trace->file);
+    }
+
+    trace->read.store(write, std::memory_order_release);
+
+    return write - read;
+}
+
+void
+trace_thread(Trace *trace)
+{
+    while (trace->running.load(std::memory_order_acquire))
+    {
+        if (drain_records(trace) == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+}
+
+void
+trace_init(Trace *trace)
+{
+    trace->level = Trace_Level::OFF;
+    trace->read.store(0, std::memory_order_relaxed);
+    trace->write.store(0, std::memory_order_relaxed);
+    trace->dropped.store(0, std::memory_order_relaxed);
+    trace->file = NULL;
+    trace->running.store(false, std::memory_order_relaxed);
+}
+
+bool
+trace_open(Trace *trace, char *path, Trace_Level level)
+{
+    if (!TRACE_ENABLED)
+    {
+        printf("[Trace] ignored, build with EMULATOR_TRACE defined to enable tracing\n");
+        return false;
+    }
+
+    trace->file = fopen(path, "w");
+
+    if (!trace->file)
+    {
+        printf("[Trace] Unable to open %s\n", path);
+        return false;
+    }
+
+    printf("[Trace] Writing %s and above to: %s\n", TRACE_LEVEL_NAMES[static_cast<u8>(level)], path);
+
+    trace->running.store(true, std::memory_order_release);
+    trace->thread = std::thread(trace_thread, trace);
+    trace->level = level;
+
+    return true;
+}
+
+void
+trace_close(Trace *trace)
+{
+    trace->level = Trace_Level::OFF;
+
+    if (!trace->file)
+    {
+        return;
+    }
+
+    trace->running.store(false, std::memory_order_release);
+    trace->thread.join();
+
+    drain_records(trace);
+
+    u32 dropped = trace->dropped.load(std::memory_order_relaxed);
+
+    if (dropped)
+    {
+        fprintf(trace->file, "[Trace] %u records dropped, drain thread fell behind\n", dropped);
+    }
+
+    fclose(trace->file);
+    trace->file = NULL;
+}
+
+bool
+trace_parse_level(char *name, Trace_Level *level)
+{
+    for (u8 i = 0; i <= static_cast<u8>(Trace_Level::OFF); ++i)
+    {
+        if (strcmp(name, TRACE_LEVEL_NAMES[i]) == 0)
+        {
+            *level = static_cast<Trace_Level>(i);
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "types.h"
+
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+// Debug builds define EMULATOR_TRACE. Release builds compile every trace_event call away
+#ifdef EMULATOR_TRACE
+constexpr bool TRACE_ENABLED = true;
+#else
+constexpr bool TRACE_ENABLED = false;
+#endif
+
+constexpr u32 TRACE_RING_SIZE = 1 << 14; // records, must be a power of two
+
+enum class Trace_Level : u8
+{
+    DEBUG,
+    INFO,
+    WARNING,
+    CRITICAL, // not ERROR, wingdi.h defines it as a macro
+    OFF
+};
+
+// Each event has a matching format string in trace.cpp taking the record's a and b values
+enum class Trace_Event : u16
+{
+    SIMULATION_BATCH, // a: cycles simulated, b: microseconds since last batch
+    ROM_BANK, // a: bank
+    RAM_BANK, // a: bank
+    RAM_ENABLE, // a: enabled
+    SERIAL_INTERRUPT,
+    COUNT
+};
+
+struct Trace_Record
+{
+    u64 cycle;
+    u32 a;
+    u32 b;
+    Trace_Event event;
+    Trace_Level level;
+};
+
+// Single producer (emulation thread) ring buffer of binary records, formatted and written to
+// file by a drain thread so a trace point only costs a level check and a few stores
+struct Trace
+{
+    Trace_Level level; // records below this level are discarded at the call site
+
+    std::atomic<u32> read;
+    std::atomic<u32> write;
+    std::atomic<u32> dropped;
+    Trace_Record records[TRACE_RING_SIZE];
+
+    FILE *file;
+    std::thread thread;
+    std::atomic<bool> running;
+};
+
+void trace_init(Trace *trace);
+bool trace_open(Trace *trace, char *path, Trace_Level level);
+void trace_close(Trace *trace);
+bool trace_parse_level(char *name, Trace_Level *level);
+
+inline void
+trace_event(Trace *trace, Trace_Level level, Trace_Event event, u64 cycle, u32 a = 0, u32 b = 0)
+{
+    if constexpr (TRACE_ENABLED)
+    {
+        if (level < trace->level)
+        {
+            return;
+        }
+
+        u32 write = trace->write.load(std::memory_order_relaxed);
+
+        if (write - trace->read.load(std::memory_order_acquire) == TRACE_RING_SIZE)
+        {
+            trace->dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        Trace_Record *record = &trace->records[write & (TRACE_RING_SIZE - 1)];
+        record->cycle = cycle;
+        record->a = a;
+        record->b = b;
+        record->event = event;
+        record->level = level;
+
+        trace->write.store(write + 1, std::memory_order_release);
+    }
+}
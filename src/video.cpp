@@ -0,0 +1,280 @@
+#include "emulator.h"
+
+#include <cstdio>
+#include <cstring>
+
+const char VIDEO_MAGIC[4] = {'G', 'B', 'V', 'D'};
+constexpr u32 VIDEO_VERSION = 1;
+
+constexpr u32 VIDEO_FRAME_SIZE = GAMEBOY_WIDTH * GAMEBOY_HEIGHT;
+constexpr u32 VIDEO_PACKED_SIZE = VIDEO_FRAME_SIZE / 4;
+constexpr u32 VIDEO_ENCODED_CAPACITY = rle_encoded_bound(VIDEO_PACKED_SIZE);
+
+// Four shades per byte, leftmost pixel in the top bits
+void
+pack_shades(u8 *frame, u8 *packed)
+{
+    for (u32 i = 0; i < VIDEO_PACKED_SIZE; ++i)
+    {
+        u8 *pixels = frame + i * 4;
+        packed[i] = (pixels[0] << 6) | (pixels[1] << 4) | (pixels[2] << 2) | pixels[3];
+    }
+}
+
+// PackBits: a header n of 0 to 127 is followed by n + 1 literal bytes, -1 to -127 by one byte
+// repeated 1 - n times. Only runs of 3 or more end a literal, a run of 2 costs as much inside one as
+// on its own, so every literal but the last either holds 128 bytes or is followed by a run that
+// saves at least the header it cost. That keeps the output within rle_encoded_bound
+u32
+rle_encode(u8 *in, u32 size, u8 *out)
+{
+    u32 i = 0;
+    u32 o = 0;
+
+    while (i < size)
+    {
+        u32 run = 1;
+
+        while (i + run < size && run < 128 && in[i + run] == in[i])
+        {
+            ++run;
+        }
+
+        if (run >= 3)
+        {
+            out[o++] = static_cast<u8>(257 - run);
+            out[o++] = in[i];
+            i += run;
+            continue;
+        }
+
+        u32 start = i;
+        u32 count = 0;
+
+        while (i < size && count < 128 && !(i + 2 < size && in[i] == in[i + 1] && in[i] == in[i + 2]))
+        {
+            ++i;
+            ++count;
+        }
+
+        out[o++] = static_cast<u8>(count - 1);
+        memcpy(out + o, in + start, count);
+        o += count;
+    }
+
+    return o;
+}
+
+// Returns the decoded size, or 0 when the input is truncated or would decode past capacity
+u32
+rle_decode(u8 *in, u32 size, u8 *out, u32 capacity)
+{
+    u32 i = 0;
+    u32 o = 0;
+
+    while (i < size)
+    {
+        u8 header = in[i++];
+
+        if (header < 128)
+        {
+            u32 count = header + 1;
+
+            if (i + count > size || o + count > capacity)
+            {
+                return 0;
+            }
+
+            memcpy(out + o, in + i, count);
+            i += count;
+            o += count;
+        }
+        else if (header > 128)
+        {
+            u32 count = 257 - header;
+
+            if (i >= size || o + count > capacity)
+            {
+                return 0;
+            }
+
+            memset(out + o, in[i++], count);
+            o += count;
+        }
+    }
+
+    return o;
+}
+
+// Little endian: magic, version, width and height as u16, the four SHADE_COLOURS, then one record per
+// written frame: frame number u64, payload size u32 and the PackBits encoding of the packed frame XOR
+// the previous written frame (all zero before the first). Frames missing between two records repeat
+// the earlier one, either because they were identical or because the queue dropped them
+void
+write_video_header(FILE *file)
+{
+    u16 width = GAMEBOY_WIDTH;
+    u16 height = GAMEBOY_HEIGHT;
+
+    fwrite(VIDEO_MAGIC, sizeof(VIDEO_MAGIC), 1, file);
+    fwrite(&VIDEO_VERSION, sizeof(VIDEO_VERSION), 1, file);
+    fwrite(&width, sizeof(width), 1, file);
+    fwrite(&height, sizeof(height), 1, file);
+    fwrite(SHADE_COLOURS, sizeof(SHADE_COLOURS), 1, file);
+}
+
+void
+video_writer_thread(Video_Recorder *video)
+{
+    u8 reference[VIDEO_PACKED_SIZE] = {};
+    u8 packed[VIDEO_PACKED_SIZE];
+    u8 encoded[VIDEO_ENCODED_CAPACITY];
+
+    for (;;)
+    {
+        u32 slot;
+        u64 frame_number;
+
+        {
+            std::unique_lock<std::mutex> lock(video->mutex);
+            video->ready.wait(lock, [video]() { return video->read != video->write || !video->running; });
+
+            // Stopping still drains everything that was queued
+            if (video->read == video->write)
+            {
+                return;
+            }
+
+            slot = video->read % VIDEO_QUEUE_FRAMES;
+            frame_number = video->queue_frame[slot];
+        }
+
+        // The producer never touches a slot until read moves past it
+        pack_shades(video->queue + slot * VIDEO_FRAME_SIZE, packed);
+
+        {
+            std::lock_guard<std::mutex> lock(video->mutex);
+            video->read++;
+        }
+
+        video->space.notify_one();
+
+        for (u32 i = 0; i < VIDEO_PACKED_SIZE; ++i)
+        {
+            u8 delta = packed[i] ^ reference[i];
+            reference[i] = packed[i];
+            packed[i] = delta;
+        }
+
+        u32 size = rle_encode(packed, VIDEO_PACKED_SIZE, encoded);
+
+        fwrite(&frame_number, sizeof(frame_number), 1, video->file);
+        fwrite(&size, sizeof(size), 1, video->file);
+        fwrite(encoded, 1, size, video->file);
+
+        video->frames_written++;
+        video->bytes_written += sizeof(frame_number) + sizeof(size) + size;
+    }
+}
+
+bool
+video_open(Video_Recorder *video, char *path, Video_Recorder::Policy policy)
+{
+    video->file = fopen(path, "wb");
+
+    if (!video->file)
+    {
+        printf("[Video] Unable to open %s\n", path);
+        return false;
+    }
+
+    printf("[Video] Writing frames to: %s\n", path);
+
+    write_video_header(video->file);
+
+    video->policy = policy;
+    video->queue = new u8[VIDEO_QUEUE_FRAMES * VIDEO_FRAME_SIZE];
+    video->read = 0;
+    video->write = 0;
+    video->has_last = false;
+    video->frames_written = 0;
+    video->frames_duplicated = 0;
+    video->frames_dropped = 0;
+    video->bytes_written = 0;
+
+    video->running = true;
+    video->thread = std::thread(video_writer_thread, video);
+
+    return true;
+}
+
+// Called on the emulation thread with each completed frame
+void
+video_push_frame(Video_Recorder *video, u8 *frame, u64 frame_number)
+{
+    if (!video->file)
+    {
+        return;
+    }
+
+    if (video->has_last && memcmp(frame, video->last, VIDEO_FRAME_SIZE) == 0)
+    {
+        video->frames_duplicated++;
+        return;
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(video->mutex);
+
+        if (video->write - video->read == VIDEO_QUEUE_FRAMES)
+        {
+            // last is left alone so the next frame is compared against what the file actually holds
+            if (video->policy == Video_Recorder::Policy::DROP)
+            {
+                video->frames_dropped++;
+                return;
+            }
+
+            video->space.wait(lock, [video]() { return video->write - video->read < VIDEO_QUEUE_FRAMES; });
+        }
+
+        u32 slot = video->write % VIDEO_QUEUE_FRAMES;
+        memcpy(video->queue + slot * VIDEO_FRAME_SIZE, frame, VIDEO_FRAME_SIZE);
+        video->queue_frame[slot] = frame_number;
+        video->write++;
+    }
+
+    video->ready.notify_one();
+
+    memcpy(video->last, frame, VIDEO_FRAME_SIZE);
+    video->has_last = true;
+}
+
+void
+video_close(Video_Recorder *video)
+{
+    if (!video->file)
+    {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(video->mutex);
+        video->running = false;
+    }
+
+    video->ready.notify_one();
+    video->thread.join();
+
+    fclose(video->file);
+    video->file = NULL;
+
+    delete[] video->queue;
+    video->queue = NULL;
+
+    printf("[Video] Wrote %llu frames in %llu bytes, %llu duplicates skipped, %llu dropped\n",
+        static_cast<unsigned long long>(video->frames_written),
+        static_cast<unsigned long long>(video->bytes_written),
+        static_cast<unsigned long long>(video->frames_duplicated),
+        static_cast<unsigned long long>(video->frames_dropped));
+}
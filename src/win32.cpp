@@ -391,6 +391,8 @@ WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdS
         start_time = end_time;
     }
 
+    shutdown_application(&app);
+
     return 0;
 }
 
@@ -0,0 +1,374 @@
+#include "emulator.h"
+#include "platform.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+constexpr u64 ROM_SIZE = 0x8000 * 2;
+constexpr u32 DEFAULT_STEPS = 4000;
+constexpr u32 POKES_PER_STEP = 8;
+
+// Homebrew ROM for the checks: VBLANK, STAT and timer handlers, a foreground loop that polls LY for
+// VBLANK, copies a counter into OAM, waits for VBLANK to end and halts until the next interrupt
+void
+build_equivalence_rom(u8 *rom)
+{
+    memset(rom, 0, ROM_SIZE);
+
+    const u8 vblank_handler[] = {
+        0xF5,             // push af
+        0xF0, 0x43,       // ldh a,(SCX)
+        0x3C,             // inc a
+        0xE0, 0x43,       // ldh (SCX),a
+        0xF1,             // pop af
+        0xD9,             // reti
+    };
+
+    const u8 stat_handler[] = {
+        0xF5,             // push af
+        0xF0, 0x81,       // ldh a,(0x81)
+        0x3C,             // inc a
+        0xE0, 0x81,       // ldh (0x81),a
+        0xF1,             // pop af
+        0xD9,             // reti
+    };
+
+    const u8 timer_handler[] = {
+        0xF5,             // push af
+        0xF0, 0x80,       // ldh a,(0x80)
+        0x3C,             // inc a
+        0xE0, 0x80,       // ldh (0x80),a
+        0xF1,             // pop af
+        0xD9,             // reti
+    };
+
+    const u8 entry[] = {
+        0x00,             // nop
+        0xC3, 0x50, 0x01, // jp 0x0150
+    };
+
+    const u8 program[] = {
+        0x31, 0xF0, 0xDF, // ld sp,0xDFF0
+        0x3E, 0x07,       // ld a,VBLANK | LCD | TIMER
+        0xE0, 0xFF,       // ldh (IE),a
+        0x3E, 0x05,       // ld a,0x05 timer on, 262144 Hz
+        0xE0, 0x07,       // ldh (TAC),a
+        0xFB,             // ei
+        // loop: 0x015C
+        0xF0, 0x44,       // ldh a,(LY)
+        0xFE, 0x90,       // cp 144
+        0x20, 0xFA,       // jr nz,loop
+        0xFA, 0x00, 0xC0, // ld a,(0xC000)
+        0x3C,             // inc a
+        0xEA, 0x00, 0xC0, // ld (0xC000),a
+        0xEA, 0x01, 0xFE, // ld (0xFE01),a
+        0xF0, 0x44,       // ldh a,(LY)
+        0xFE, 0x90,       // cp 144
+        0x28, 0xFA,       // jr z,-6
+        0x76,             // halt
+        0x18, 0xE7,       // jr loop
+    };
+
+    memcpy(rom + 0x0040, vblank_handler, sizeof(vblank_handler));
+    memcpy(rom + 0x0048, stat_handler, sizeof(stat_handler));
+    memcpy(rom + 0x0050, timer_handler, sizeof(timer_handler));
+    memcpy(rom + 0x0100, entry, sizeof(entry));
+    memcpy(rom + 0x0150, program, sizeof(program));
+
+    memcpy(rom + 0x0134, "EQUIVALENCE", 11);
+    rom[0x0147] = 0x01; // MBC1
+}
+
+// xorshift32, the same sequence on every platform
+u32
+next_random(u32 *state)
+{
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+// The configurations a check runs side by side. run advances by exactly cycles
+struct Variant
+{
+    const char *name;
+    void (*setup)(GameBoy *gb);
+    Run_Cycles_Function run;
+};
+
+// conditions also steps both through gameboy_run_frame and gameboy_run_until, which only the
+// public run loop has
+struct Check
+{
+    const char *name;
+    Variant a;
+    Variant b;
+    bool conditions;
+};
+
+void
+setup_none(GameBoy *)
+{
+}
+
+void
+setup_no_idle_skip(GameBoy *gb)
+{
+    gb->idle_skip = false;
+}
+
+void
+setup_renderer(GameBoy *gb)
+{
+    ppu_start_renderer(&gb->ppu, &gb->memory_bus);
+}
+
+const Check CHECKS[] = {
+    {"idle_skip", {"skip", setup_none, gameboy_run_cycles}, {"no skip", setup_no_idle_skip, gameboy_run_cycles}, true},
+    {"renderer", {"inline", setup_none, gameboy_run_cycles}, {"render thread", setup_renderer, gameboy_run_cycles}, true},
+    {"reference", {"fast", setup_none, gameboy_run_cycles}, {"reference", setup_none, gameboy_run_reference_cycles}, false},
+    {"reference_no_skip", {"fast no skip", setup_no_idle_skip, gameboy_run_cycles}, {"reference", setup_none, gameboy_run_reference_cycles}, false},
+};
+
+// The lines drawn so far, which the render thread keeps in its own buffer until VBLANK
+u8 *
+visible_frame(GameBoy *gb)
+{
+    if (gb->ppu.renderer)
+    {
+        ppu_render_sync(&gb->ppu);
+        return gb->ppu.renderer->frame_buffer;
+    }
+
+    return gb->ppu.frame_buffer;
+}
+
+// Prints the first difference, returns whether both instances are in the same state
+bool
+same_state(GameBoy *a, GameBoy *b)
+{
+    if (memcmp(a->cpu.registers, b->cpu.registers, sizeof(a->cpu.registers)) != 0 || a->cpu.pc != b->cpu.pc ||
+        a->cpu.sp != b->cpu.sp || a->cpu.interrupt_master_enable != b->cpu.interrupt_master_enable ||
+        a->cpu.halted != b->cpu.halted)
+    {
+        printf("    CPU: pc %04X/%04X sp %04X/%04X\n", a->cpu.pc, b->cpu.pc, a->cpu.sp, b->cpu.sp);
+        return false;
+    }
+
+    if (a->memory_bus.cycles != b->memory_bus.cycles)
+    {
+        printf("    cycles: %llu/%llu\n", static_cast<unsigned long long>(a->memory_bus.cycles), static_cast<unsigned long long>(b->memory_bus.cycles));
+        return false;
+    }
+
+    for (u32 address = 0; address <= 0xFFFF; ++address)
+    {
+        if (a->memory_bus.memory[address] != b->memory_bus.memory[address])
+        {
+            printf("    [%04X]: %02X/%02X\n", address, a->memory_bus.memory[address], b->memory_bus.memory[address]);
+            return false;
+        }
+    }
+
+    if (memcmp(visible_frame(a), visible_frame(b), GAMEBOY_WIDTH * GAMEBOY_HEIGHT) != 0)
+    {
+        printf("    frame_buffer differs\n");
+        return false;
+    }
+
+    return true;
+}
+
+// Writes through the bus to registers, VRAM and OAM that change how the PPU draws. The LCD is
+// switched off now and then
+void
+poke(GameBoy *a, GameBoy *b, u32 *seed)
+{
+    const u16 registers[] = {0xFF40, 0xFF41, 0xFF42, 0xFF43, 0xFF45, 0xFF47, 0xFF48, 0xFF49, 0xFF4A, 0xFF4B, 0xFF46};
+
+    for (u32 i = 0; i < POKES_PER_STEP; ++i)
+    {
+        u32 r = next_random(seed);
+        u16 address;
+        u8 value = static_cast<u8>(next_random(seed));
+
+        switch (r % 4)
+        {
+            case 0:
+                address = registers[(r >> 2) % (sizeof(registers) / sizeof(registers[0]))];
+
+                if (address == 0xFF40 && r % 64 != 0)
+                {
+                    value |= 0x80;
+                }
+                else if (address == 0xFF46)
+                {
+                    value = 0xC0; // OAM DMA from WRAM
+                }
+                else if (address == 0xFF4A)
+                {
+                    value %= GAMEBOY_HEIGHT;
+                }
+                break;
+            case 1:
+                address = 0x8000 + (r >> 2) % 0x1800;
+                break;
+            case 2:
+                address = 0x9800 + (r >> 2) % 0x800;
+                break;
+            default:
+                address = (r >> 16) % 2 ? OAM_START_ADDRESS + (r >> 2) % 0xA0 : 0xC000 + (r >> 2) % 0xA0;
+                break;
+        }
+
+        a->memory_bus.write_u8(address, value);
+        b->memory_bus.write_u8(address, value);
+    }
+}
+
+GameBoy *
+create_instance(u8 *rom, u64 size, const Variant *variant)
+{
+    GameBoy *gb = new GameBoy();
+
+    if (!cartridge_load(&gb->memory_bus.cartridge, rom, size))
+    {
+        delete gb;
+        return NULL;
+    }
+
+    gameboy_init(gb);
+    variant->setup(gb);
+
+    return gb;
+}
+
+// Steps both variants through the same random mix of cycle counts, frames and conditions with the
+// same bus writes in between, comparing after every step
+bool
+run_check(const Check *check, u8 *rom, u64 size, u32 steps, u32 seed)
+{
+    GameBoy *a = create_instance(rom, size, &check->a);
+    GameBoy *b = create_instance(rom, size, &check->b);
+    bool passed = a && b;
+
+    for (u32 step = 0; passed && step < steps; ++step)
+    {
+        u32 r = next_random(&seed);
+        u32 kind = check->conditions ? r % 4 : r % 2;
+        u64 cycles = 1 + (r >> 2) % (kind == 0 ? 20 : 6000);
+
+        if (kind <= 1)
+        {
+            check->a.run(a, cycles);
+            check->b.run(b, cycles);
+        }
+        else if (kind == 2)
+        {
+            passed = gameboy_run_frame(a) == gameboy_run_frame(b);
+        }
+        else
+        {
+            Run_Condition condition = {};
+            condition.type = Run_Condition::Type::LY;
+            condition.value = (r >> 2) % 154;
+
+            passed = gameboy_run_until(a, condition, cycles) == gameboy_run_until(b, condition, cycles);
+        }
+
+        passed = passed && same_state(a, b);
+
+        if (!passed)
+        {
+            printf("    %s and %s diverged at step %u, cycle %llu\n", check->a.name, check->b.name, step,
+                static_cast<unsigned long long>(a ? a->memory_bus.cycles : 0));
+        }
+
+        if (next_random(&seed) % 8 == 0)
+        {
+            poke(a, b, &seed);
+        }
+    }
+
+    for (GameBoy *gb : {a, b})
+    {
+        if (gb)
+        {
+            ppu_stop_renderer(&gb->ppu);
+            delete gb;
+        }
+    }
+
+    return passed;
+}
+
+int main(int argc, char **argv)
+{
+    u32 steps = DEFAULT_STEPS;
+    u32 seed = 1;
+    char *rom_path = NULL;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--steps") == 0 && i + 1 < argc)
+        {
+            steps = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--rom") == 0 && i + 1 < argc)
+        {
+            rom_path = argv[++i];
+        }
+        else
+        {
+            printf("Usage: equivalence [--steps n] [--seed n] [--rom file]\n");
+            return 1;
+        }
+    }
+
+    // xorshift never leaves 0
+    seed = seed ? seed : 1;
+
+    u64 size = ROM_SIZE;
+    u8 *rom;
+
+    if (rom_path)
+    {
+        rom = read_file(rom_path, &size);
+
+        if (!rom)
+        {
+            printf("[Equivalence] Unable to read %s\n", rom_path);
+            return 1;
+        }
+    }
+    else
+    {
+        rom = static_cast<u8*>(malloc(ROM_SIZE));
+        build_equivalence_rom(rom);
+    }
+
+    u32 failed = 0;
+
+    for (const Check &check : CHECKS)
+    {
+        bool passed = run_check(&check, rom, size, steps, seed);
+        failed += passed ? 0 : 1;
+
+        printf("%-8s %s (%s vs %s)\n", passed ? "PASS" : "FAIL", check.name, check.a.name, check.b.name);
+    }
+
+    free(rom);
+
+    printf("\n%u checks, %u failed\n", static_cast<u32>(sizeof(CHECKS) / sizeof(CHECKS[0])), failed);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,325 @@
+#include "emulator.h"
+#include "platform.h"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+constexpr u32 MANIFEST_LINE_LENGTH = 512;
+
+struct Checkpoint
+{
+    u64 frames;
+    u64 expected; // only valid when recorded is set
+    u64 actual;
+    bool recorded;
+    u32 line; // index into Manifest::lines
+};
+
+struct Golden_Rom
+{
+    enum class Result
+    {
+        PASS,
+        FAIL,
+        NEW,
+        MISSING,
+    };
+
+    std::string path;
+    std::vector<Checkpoint> checkpoints;
+    Result result;
+};
+
+// Lines are kept verbatim so --update only rewrites the hash column
+struct Manifest
+{
+    std::vector<std::string> lines;
+    std::vector<Golden_Rom> roms;
+};
+
+// One entry per line: <rom> <frames> <hash>, paths are relative to the ROM directory. Consecutive lines
+// for the same ROM are checkpoints of a single run and must be in increasing frame order. A hash of -
+// has not been recorded yet
+bool
+read_manifest(char *path, Manifest *manifest)
+{
+    FILE *file = fopen(path, "r");
+
+    if (!file)
+    {
+        printf("[Golden] Unable to open manifest %s\n", path);
+        return false;
+    }
+
+    char line[MANIFEST_LINE_LENGTH];
+
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\r\n")] = 0;
+
+        u32 index = static_cast<u32>(manifest->lines.size());
+        manifest->lines.push_back(line);
+
+        char rom[MANIFEST_LINE_LENGTH];
+        unsigned long long frames;
+        char hash[32];
+
+        if (line[0] == '#' || sscanf(line, "%511s %llu %31s", rom, &frames, hash) != 3)
+        {
+            continue;
+        }
+
+        if (manifest->roms.empty() || manifest->roms.back().path != rom ||
+            manifest->roms.back().checkpoints.back().frames >= frames)
+        {
+            manifest->roms.push_back({rom, {}, Golden_Rom::Result::PASS});
+        }
+
+        Checkpoint checkpoint = {};
+        checkpoint.frames = frames;
+        checkpoint.recorded = strcmp(hash, "-") != 0;
+        checkpoint.expected = checkpoint.recorded ? strtoull(hash, NULL, 16) : 0;
+        checkpoint.line = index;
+
+        manifest->roms.back().checkpoints.push_back(checkpoint);
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+bool
+write_manifest(char *path, Manifest *manifest)
+{
+    for (Golden_Rom &rom : manifest->roms)
+    {
+        if (rom.result == Golden_Rom::Result::MISSING)
+        {
+            continue;
+        }
+
+        for (Checkpoint &checkpoint : rom.checkpoints)
+        {
+            char line[MANIFEST_LINE_LENGTH];
+            snprintf(line, sizeof(line), "%s %llu %016llx", rom.path.c_str(),
+                static_cast<unsigned long long>(checkpoint.frames),
+                static_cast<unsigned long long>(checkpoint.actual));
+
+            manifest->lines[checkpoint.line] = line;
+        }
+    }
+
+    FILE *file = fopen(path, "w");
+
+    if (!file)
+    {
+        printf("[Golden] Unable to write manifest %s\n", path);
+        return false;
+    }
+
+    for (std::string &line : manifest->lines)
+    {
+        fprintf(file, "%s\n", line.c_str());
+    }
+
+    fclose(file);
+
+    return true;
+}
+
+// Runs the ROM from power on and hashes the frame buffer at every checkpoint. Frames are counted with
+// gameboy_run_frame so a ROM that keeps the LCD off still advances a frame worth of cycles each time
+void
+run_golden_rom(Golden_Rom *rom, char *directory)
+{
+    std::string path = std::string(directory) + "/" + rom->path;
+
+    u64 size;
+    u8 *data = read_file(const_cast<char*>(path.c_str()), &size);
+
+    if (!data)
+    {
+        rom->result = Golden_Rom::Result::MISSING;
+        return;
+    }
+
+    GameBoy *gb = new GameBoy();
+
+    if (!cartridge_load(&gb->memory_bus.cartridge, data, size))
+    {
+        rom->result = Golden_Rom::Result::MISSING;
+        delete gb;
+        free(data);
+        return;
+    }
+
+    gameboy_init(gb);
+
+    u64 frames = 0;
+    bool recorded = true;
+    bool matched = true;
+
+    for (Checkpoint &checkpoint : rom->checkpoints)
+    {
+        for (; frames < checkpoint.frames; ++frames)
+        {
+            gameboy_run_frame(gb);
+            apu_end_block(&gb->apu, gb->memory_bus.cycles);
+        }
+
+        checkpoint.actual = gameboy_frame_hash(gb);
+
+        recorded &= checkpoint.recorded;
+        matched &= !checkpoint.recorded || checkpoint.actual == checkpoint.expected;
+    }
+
+    rom->result = !matched ? Golden_Rom::Result::FAIL : recorded ? Golden_Rom::Result::PASS : Golden_Rom::Result::NEW;
+
+    delete gb;
+    free(data);
+}
+
+void
+run_claimed_roms(Manifest *manifest, char *directory, std::atomic<u32> *next)
+{
+    u32 count = static_cast<u32>(manifest->roms.size());
+
+    for (u32 i = next->fetch_add(1); i < count; i = next->fetch_add(1))
+    {
+        run_golden_rom(&manifest->roms[i], directory);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    char *manifest_path = const_cast<char*>("test/golden/manifest.txt");
+    char *directory = const_cast<char*>("test/golden/roms");
+    char *filter = NULL;
+    u32 threads = 0;
+    bool update = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--manifest") == 0 && i + 1 < argc)
+        {
+            manifest_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--roms") == 0 && i + 1 < argc)
+        {
+            directory = argv[++i];
+        }
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            filter = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+        {
+            threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--update") == 0)
+        {
+            update = true;
+        }
+        else
+        {
+            printf("Usage: golden [--manifest file] [--roms directory] [--filter name] [--threads n] [--update]\n");
+            return 1;
+        }
+    }
+
+    Manifest manifest;
+
+    if (!read_manifest(manifest_path, &manifest))
+    {
+        return 1;
+    }
+
+    if (filter)
+    {
+        std::vector<Golden_Rom> selected;
+
+        for (Golden_Rom &rom : manifest.roms)
+        {
+            if (strstr(rom.path.c_str(), filter))
+            {
+                selected.push_back(rom);
+            }
+        }
+
+        manifest.roms.swap(selected);
+    }
+
+    if (threads == 0)
+    {
+        threads = std::thread::hardware_concurrency();
+    }
+
+    std::atomic<u32> next(0);
+    std::vector<std::thread> workers;
+
+    for (u32 i = 1; i < threads && i < manifest.roms.size(); ++i)
+    {
+        workers.emplace_back(run_claimed_roms, &manifest, directory, &next);
+    }
+
+    run_claimed_roms(&manifest, directory, &next);
+
+    for (std::thread &worker : workers)
+    {
+        worker.join();
+    }
+
+    const char *results[] = {"PASS", "FAIL", "NEW", "MISSING"};
+    u32 totals[4] = {};
+
+    printf("\n");
+
+    for (Golden_Rom &rom : manifest.roms)
+    {
+        totals[static_cast<u32>(rom.result)]++;
+        printf("%-8s %s\n", results[static_cast<u32>(rom.result)], rom.path.c_str());
+
+        if (rom.result != Golden_Rom::Result::FAIL)
+        {
+            continue;
+        }
+
+        for (Checkpoint &checkpoint : rom.checkpoints)
+        {
+            if (checkpoint.recorded && checkpoint.actual != checkpoint.expected)
+            {
+                printf("         frame %llu: expected %016llx, got %016llx\n",
+                    static_cast<unsigned long long>(checkpoint.frames),
+                    static_cast<unsigned long long>(checkpoint.expected),
+                    static_cast<unsigned long long>(checkpoint.actual));
+            }
+        }
+    }
+
+    printf("\n%u passed, %u failed, %u new, %u missing\n", totals[0], totals[1], totals[2], totals[3]);
+
+    if (update)
+    {
+        if (!write_manifest(manifest_path, &manifest))
+        {
+            return 1;
+        }
+
+        printf("[Golden] Recorded hashes in %s\n", manifest_path);
+        return 0;
+    }
+
+    // A checkpoint without a recorded hash verifies nothing, so it fails the run until --update records it
+    if (totals[static_cast<u32>(Golden_Rom::Result::NEW)])
+    {
+        printf("[Golden] %s has checkpoints with no recorded hash, run --update on a known good build\n", manifest_path);
+    }
+
+    return totals[static_cast<u32>(Golden_Rom::Result::FAIL)] || totals[static_cast<u32>(Golden_Rom::Result::NEW)] ? 1 : 0;
+}
@@ -2,15 +2,85 @@
 #include "emulator.h"
 
 #include <cstdio>
+#include <cstring>
 #include <filesystem>
 #include <iostream>
 #include <fstream>
+#include <vector>
 
 using json = nlohmann::json;
 namespace fs = std::filesystem;
 
+// Encodes and decodes input, checking the encoding stays within rle_encoded_bound
+bool
+rle_round_trip(u8 *input, u32 size)
+{
+    std::vector<u8> encoded(size * 2 + 2);
+    std::vector<u8> decoded(size + 1);
+
+    u32 encoded_size = rle_encode(input, size, encoded.data());
+    u32 decoded_size = rle_decode(encoded.data(), encoded_size, decoded.data(), size);
+
+    return encoded_size <= rle_encoded_bound(size) && decoded_size == size && memcmp(decoded.data(), input, size) == 0;
+}
+
+// Every input of up to 16 bytes drawn from two values, then frame sized inputs built from short runs
+// that cost the most when a run of 2 ends a literal
+bool
+test_rle()
+{
+    u8 input[GAMEBOY_WIDTH * GAMEBOY_HEIGHT / 4];
+
+    for (u32 length = 0; length <= 16; ++length)
+    {
+        for (u32 bits = 0; bits < (1u << length); ++bits)
+        {
+            for (u32 i = 0; i < length; ++i)
+            {
+                input[i] = (bits >> i) & 1;
+            }
+
+            if (!rle_round_trip(input, length))
+            {
+                printf("RLE round trip failed for %u bytes %04X\n", length, bits);
+                return false;
+            }
+        }
+    }
+
+    u32 random = 1;
+    const u32 periods[] = {2, 3, 4, 5, 131};
+
+    for (u32 period : periods)
+    {
+        for (u32 i = 0; i < sizeof(input); ++i)
+        {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+
+            input[i] = i % period == 0 ? 0xFF : period == 131 ? static_cast<u8>(random) : 0;
+        }
+
+        if (!rle_round_trip(input, sizeof(input)))
+        {
+            printf("RLE round trip failed for period %u\n", period);
+            return false;
+        }
+    }
+
+    printf("RLE round trip passed\n");
+
+    return true;
+}
+
 int main(int argc, char **argv)
 {
+    if (!test_rle())
+    {
+        return 1;
+    }
+
     if (argc < 2) 
     {
         printf("Please provide a path to the cpu test jsons\n");
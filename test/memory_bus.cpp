@@ -4,6 +4,11 @@ void
 Memory_Bus::write_u8(u16 address, u8 v) 
 {
     memory[address] = v;
+
+    if (address == INTERRUPT_FLAG || address == INTERRUPT_ENABLE)
+    {
+        memory_bus_update_interrupts(this);
+    }
 }
 
 u8 
@@ -38,11 +43,21 @@ Memory_Bus::read_u16(u16 address)
 }
 
 void
-memory_bus_init(Memory_Bus *memory_bus, Timers *timers)
+memory_bus_init(Memory_Bus *memory_bus, Timers *timers, PPU *ppu, APU *apu, Profiler *profiler, Trace *trace)
 {
     memory_bus->timers = timers;
+    memory_bus->ppu = ppu;
+    memory_bus->apu = apu;
+    memory_bus->profiler = profiler;
+    memory_bus->trace = trace;
+    memory_bus->cycles = 0;
     memory_bus->memory[JOYPAD_REGISTER] = 0x3F;
-    memory_bus->joypad.state = 0xFF;
-    memory_bus->joypad.button = false;
-    memory_bus->joypad.direction = false;
+    memory_bus_update_interrupts(memory_bus);
+    joypad_init(&memory_bus->joypad);
+}
+
+void
+memory_bus_update_interrupts(Memory_Bus *memory_bus)
+{
+    memory_bus->interrupts_pending = memory_bus->memory[INTERRUPT_FLAG] & memory_bus->memory[INTERRUPT_ENABLE] & 0x1F;
 }
\ No newline at end of file